@@ -12,6 +12,8 @@ public:
     RTKTest(int screenWidth, int screenHeight) : Game(screenWidth, screenHeight){
         m_runtime.RegisterFile("json.txt","debug");
         m_runtime.LoadJson("debug");
+        m_runtime.EnablePartialRedraw(LIGHTGRAY);
+        EnableIdleMode();
         return;
         m_debug = fopen("debug.txt","w");
         m_winMan = new RTK::WindowManager({0,0,1600,900},0.1f,10);
@@ -40,7 +42,7 @@ public:
         numeric->DisableWrapAtMinimumFontSize();
         numeric->EnableDrawCharacterCount();
         numeric->SetCharacterLimit(8);
-        numeric->SetFilterFunction(&RTK::IsNumeric);
+        numeric->SetFilter(RTK::NumericFilter);
         numeric->SetFontMargin({0.05,0.05});
         numeric->SetHorizontalAlign(RTK::TextAlign::Start);
         numeric->FixedTextSize();
@@ -77,15 +79,18 @@ public:
 
     void UpdateFrame() override{
         //m_winMan->Update();
-        m_runtime.Update();
-        if(IsKeyPressed(KEY_TAB)){
+        m_runtime.Update(m_input);
+        if(m_input.IsKeyPressed(KEY_TAB)){
             fprintf(m_debug,"----------------\n");
         }
     }
 
+    bool HasPendingWork() override{
+        return m_runtime.HasPendingWork();
+    }
+
     void DrawFrame() override{
         BeginDrawing();
-        ClearBackground(LIGHTGRAY);
         //m_winMan->Draw();
         m_runtime.Draw();
         EndDrawing();
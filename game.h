@@ -14,6 +14,9 @@ public:
     // It should also hold your "global" variables
     int m_screenWidth = 1600;
     int m_screenHeight = 900;
+    bool m_idleMode = false; // Block waiting for events instead of drawing frames that would look the same
+    RTK::InputState m_input; // Captured once per frame before UpdateFrame
+    RTK::InputRecorder m_recorder; // Writes m_input every frame while open, see RTK::ReplayInput
 
     Game(int screenWidth, int screenHeight){
         InitWindow(m_screenWidth, m_screenHeight, "rtk");
@@ -26,11 +29,44 @@ public:
 
     void Run(){
         while (!WindowShouldClose()) {
-            DrawFrame();
+            if(!m_idleMode || HasPendingWork() || m_input.Active()){
+                if(m_idleMode) DisableEventWaiting();
+                DrawFrame();
+            }
+            else{
+                //Nothing to draw, sleep until input arrives or another thread calls RTK::PostWake
+                EnableEventWaiting();
+                PollInputEvents();
+            }
+            m_input = RTK::InputState::Capture();
+            m_recorder.Record(m_input);
             UpdateFrame();
         }
     }
 
+    bool StartInputRecording(const char *path){
+        return m_recorder.Open(path);
+    }
+
+    void StopInputRecording(){
+        m_recorder.Close();
+    }
+
+    void EnableIdleMode(){
+        //Frames are only drawn while HasPendingWork or input says something may have changed
+        m_idleMode = true;
+    }
+
+    void DisableIdleMode(){
+        m_idleMode = false;
+        DisableEventWaiting();
+    }
+
+    virtual bool HasPendingWork(){
+        //Override when using idle mode, true when the next frame would differ from the last one drawn
+        return true;
+    }
+
     virtual void DrawFrame(){
         BeginDrawing();
         ClearBackground(RAYWHITE);
@@ -11,16 +11,35 @@
 #include "json.hpp"
 #include <fstream>
 #include <unordered_set>
+#include <unordered_map>
+#include <string_view>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <cassert>
+#include <cstring>
 
 using json = nlohmann::json;
 
+#ifndef RTK_NO_GLFW_WAKE
+//raylib's desktop build links GLFW, whose empty event interrupts a blocking wait for events from any thread
+extern "C" void glfwPostEmptyEvent(void);
+#endif
+
 namespace RTK{
 #define SPACING 16 //Based off of default parameters in DrawText()
 #define GET_SPACING(_size) (_size < SPACING ? 1 : _size/SPACING)
 
-#define MACRO_CTRL(_key) (IsKeyPressed(_key) && IsKeyDown(KEY_LEFT_CONTROL))
-#define MACRO_SHIFT(_key) (IsKeyPressed(_key) && IsKeyDown(KEY_LEFT_SHIFT))
-#define MACRO_ALT(_key) (IsKeyPressed(_key) && IsKeyDown(KEY_LEFT_ALT))
+#define MACRO_CTRL(_input, _key) ((_input).IsKeyPressed(_key) && (_input).IsKeyDown(KEY_LEFT_CONTROL))
+#define MACRO_SHIFT(_input, _key) ((_input).IsKeyPressed(_key) && (_input).IsKeyDown(KEY_LEFT_SHIFT))
+#define MACRO_ALT(_input, _key) ((_input).IsKeyPressed(_key) && (_input).IsKeyDown(KEY_LEFT_ALT))
 
 
 #define CONTINUOUS_TYPING_DELAY 35 // The amount of frames of holding down a key before it is spammed
@@ -33,6 +52,72 @@ bool IsNumeric(int key){
 
 }
 
+#define CHARACTER_FILTER_SIZE 512 // Key codes and characters a CharacterFilter can hold, raylib's key codes end at 348
+
+    class CharacterFilter{
+        /* A set of key codes/characters where testing a key is a single bit lookup. Sets are built at compile time from
+         * ranges and combined with |, & and ~. A bool(*)(int) predicate still converts to a filter: it is evaluated once
+         * for every key in range and stored as bits, so it should not depend on anything that changes later.*/
+        std::array<uint64_t, CHARACTER_FILTER_SIZE / 64> m_bits{};
+
+    public:
+        constexpr CharacterFilter() = default;
+
+        CharacterFilter(bool (*predicate)(int)){
+            for(int key = 0; key < CHARACTER_FILTER_SIZE; key++){
+                if(predicate(key)) m_bits[key >> 6] |= (uint64_t)1 << (key & 63);
+            }
+        }
+
+        static constexpr CharacterFilter Range(int first, int last){
+            CharacterFilter filter;
+            for(int key = std::max(first, 0); key <= last && key < CHARACTER_FILTER_SIZE; key++){
+                filter.m_bits[key >> 6] |= (uint64_t)1 << (key & 63);
+            }
+            return filter;
+        }
+
+        static constexpr CharacterFilter Single(int key){
+            return Range(key, key);
+        }
+
+        [[nodiscard]] constexpr bool Contains(int key) const {
+            return key >= 0 && key < CHARACTER_FILTER_SIZE && ((m_bits[key >> 6] >> (key & 63)) & 1);
+        }
+
+        constexpr bool operator()(int key) const {
+            return Contains(key);
+        }
+
+        constexpr CharacterFilter operator|(const CharacterFilter &other) const {
+            CharacterFilter filter;
+            for(size_t i = 0; i < m_bits.size(); i++) filter.m_bits[i] = m_bits[i] | other.m_bits[i];
+            return filter;
+        }
+
+        constexpr CharacterFilter operator&(const CharacterFilter &other) const {
+            CharacterFilter filter;
+            for(size_t i = 0; i < m_bits.size(); i++) filter.m_bits[i] = m_bits[i] & other.m_bits[i];
+            return filter;
+        }
+
+        constexpr CharacterFilter operator~() const {
+            CharacterFilter filter;
+            for(size_t i = 0; i < m_bits.size(); i++) filter.m_bits[i] = ~m_bits[i];
+            return filter;
+        }
+
+        bool operator==(const CharacterFilter &other) const {return m_bits == other.m_bits;}
+
+        bool operator<(const CharacterFilter &other) const {return m_bits < other.m_bits;}
+    };
+
+    constexpr CharacterFilter AsciiFilter = CharacterFilter::Range(32, 96) | CharacterFilter::Range(256, 265); // Same keys as IsAscii
+    constexpr CharacterFilter NumericFilter = CharacterFilter::Range(45, 57) & ~CharacterFilter::Single(KEY_SLASH); // Same keys as IsNumeric
+    constexpr CharacterFilter DigitFilter = CharacterFilter::Range('0', '9');
+    constexpr CharacterFilter HexFilter = DigitFilter | CharacterFilter::Range('A', 'F') | CharacterFilter::Range('a', 'f');
+    constexpr CharacterFilter AsciiPrintableFilter = CharacterFilter::Range(32, 126);
+
 Rectangle RectangleFromJson(const json &j){
     auto r = j["rectangle"];
     return {r[0],r[1],r[2],r[3]};
@@ -57,6 +142,287 @@ void JsonFromRectangle(json &j, Rectangle r){
     };
 #define RTK_STATES_COUNT 4
 
+    void ReleaseFontCaches(Font font); // Drops everything rtk derived from a font, defined with those caches
+
+    class RenderBackend;
+    RenderBackend *DefaultBackend(); // The raylib backend, defined with it
+    RenderBackend *renderBackend = nullptr; // Set with SetBackend, DefaultBackend while null
+
+    class RenderBackend{
+        /* Everything rtk needs from a window, a GPU or an input device. Elements only talk to the backend returned by
+         * Backend(), so the same widget code runs against raylib, records commands headless or rasterizes on the CPU.
+         * Coordinates are screen coordinates, render targets shift them by their camera's target.*/
+    public:
+        virtual ~RenderBackend(){
+            if(renderBackend == this) renderBackend = nullptr;
+        }
+
+        //Drawing
+        virtual void DrawRectangle(Rectangle rect, Color color) = 0;
+        virtual void DrawRectangleLines(Rectangle rect, float thickness, Color color) = 0;
+        virtual void DrawText(Font font, const char *text, Vector2 position, float fontSize, float spacing, Color tint) = 0;
+        virtual void DrawTexture(Texture2D texture, Rectangle source, Rectangle destination, Color tint) = 0;
+        virtual void Clear(Color color) = 0;
+        virtual void BeginScissor(int x, int y, int width, int height) = 0; // In pixels of the current target
+        virtual void EndScissor() = 0;
+
+        //Render targets
+        virtual RenderTexture2D LoadRenderTarget(int width, int height) = 0; // id 0 when it could not be created
+        virtual void UnloadRenderTarget(RenderTexture2D target) = 0;
+        virtual void BeginRenderTarget(RenderTexture2D target, Camera2D camera) = 0;
+        virtual void EndRenderTarget() = 0;
+
+        //Fonts and measurement
+        virtual Font LoadFont(const char *path, int baseSize, const int *codepoints, int codepointCount) = 0;
+        virtual void UnloadFont(Font font) = 0;
+        virtual Vector2 MeasureText(Font font, const char *text, float fontSize, float spacing) = 0;
+
+        //Input
+        virtual Vector2 GetMousePosition() = 0;
+        virtual Vector2 GetMouseDelta() = 0;
+        virtual float GetMouseWheelMove() = 0; // Positive away from the user
+        virtual bool IsMouseButtonDown(int button) = 0;
+        virtual bool IsMouseButtonPressed(int button) = 0;
+        virtual bool IsMouseButtonReleased(int button) = 0;
+        virtual bool IsKeyDown(int key) = 0;
+        virtual bool IsKeyPressed(int key) = 0;
+        virtual int GetKeyPressed() = 0; // Pops the next key pressed this frame, 0 when there are none
+        virtual float GetFrameTime() = 0;
+        virtual void Wake() {} // Thread safe, interrupts a wait for input events
+
+        //Screen
+        virtual int GetScreenWidth() = 0;
+        virtual int GetScreenHeight() = 0;
+        virtual bool IsReady() = 0; // False once resources can no longer be freed, after CloseWindow for raylib
+    };
+
+    RenderBackend &Backend(){
+        return renderBackend ? *renderBackend : *DefaultBackend();
+    }
+
+    void SetBackend(RenderBackend &backend){
+        //Call before loading fonts or creating elements, resources are released through the backend that is current
+        renderBackend = &backend;
+    }
+
+    std::atomic<bool> wakePosted{false};
+
+    void PostWake(){
+        //Safe from any thread. The next frame runs and redraws even when the loop is idle waiting for input
+        wakePosted = true;
+        Backend().Wake();
+    }
+
+#define INPUT_KEY_COUNT 512 // Keys tracked by InputState, raylib's key codes stay below this
+
+    struct InputState{
+        /* Everything elements read from the mouse and keyboard, captured once per frame and passed down the element
+         * tree. Elements are updated topmost first, an element that handles the mouse or the keyboard consumes it
+         * and the elements below it see no mouse over them, no buttons and no keys for the rest of the frame.*/
+        Vector2 mouse = {0, 0};
+        Vector2 mouseDelta = {0, 0};
+        float mouseWheel = 0; // Positive away from the user
+        std::array<bool,3> buttonDown{};
+        std::array<bool,3> buttonPressed{};
+        std::array<bool,3> buttonReleased{};
+        std::array<bool,INPUT_KEY_COUNT> keyDown{};
+        std::array<bool,INPUT_KEY_COUNT> keyPressed{};
+        std::vector<int> keys; // Keys pressed this frame, in order
+        float frameTime = 0;
+        bool mouseConsumed = false;
+        bool keyboardConsumed = false;
+
+        static InputState Capture(){
+            //Reads the backend's input for this frame, draining its key queue
+            InputState input;
+            RenderBackend &backend = Backend();
+            input.mouse = backend.GetMousePosition();
+            input.mouseDelta = backend.GetMouseDelta();
+            input.mouseWheel = backend.GetMouseWheelMove();
+            for(int button = MOUSE_BUTTON_LEFT; button <= MOUSE_BUTTON_MIDDLE; button++){
+                input.buttonDown[button] = backend.IsMouseButtonDown(button);
+                input.buttonPressed[button] = backend.IsMouseButtonPressed(button);
+                input.buttonReleased[button] = backend.IsMouseButtonReleased(button);
+            }
+            for(int key = 1; key < INPUT_KEY_COUNT; key++){
+                input.keyDown[key] = backend.IsKeyDown(key);
+                input.keyPressed[key] = backend.IsKeyPressed(key);
+            }
+            for(int key = backend.GetKeyPressed(); key != 0; key = backend.GetKeyPressed()){
+                input.keys.push_back(key);
+            }
+            input.frameTime = backend.GetFrameTime();
+            return input;
+        }
+
+        [[nodiscard]] bool Active() const {
+            //Whether the mouse moved or any button or key went down or up this frame. Held keys and buttons don't count
+            if(mouseDelta.x != 0 || mouseDelta.y != 0 || mouseWheel != 0 || !keys.empty()) return true;
+            for(int button = MOUSE_BUTTON_LEFT; button <= MOUSE_BUTTON_MIDDLE; button++){
+                if(buttonPressed[button] || buttonReleased[button]) return true;
+            }
+            return std::find(keyPressed.begin(), keyPressed.end(), true) != keyPressed.end();
+        }
+
+        [[nodiscard]] bool MouseOver(Rectangle rect) const {
+            return !mouseConsumed && CheckCollisionPointRec(mouse, rect);
+        }
+
+        [[nodiscard]] float GetMouseWheelMove() const {
+            return mouseConsumed ? 0 : mouseWheel;
+        }
+
+        [[nodiscard]] bool IsMouseButtonDown(int button) const {
+            return !mouseConsumed && button >= 0 && button < 3 && buttonDown[button];
+        }
+
+        [[nodiscard]] bool IsMouseButtonPressed(int button) const {
+            return !mouseConsumed && button >= 0 && button < 3 && buttonPressed[button];
+        }
+
+        [[nodiscard]] bool IsMouseButtonReleased(int button) const {
+            return !mouseConsumed && button >= 0 && button < 3 && buttonReleased[button];
+        }
+
+        [[nodiscard]] bool IsKeyDown(int key) const {
+            return !keyboardConsumed && key > 0 && key < INPUT_KEY_COUNT && keyDown[key];
+        }
+
+        [[nodiscard]] bool IsKeyPressed(int key) const {
+            return !keyboardConsumed && key > 0 && key < INPUT_KEY_COUNT && keyPressed[key];
+        }
+
+        [[nodiscard]] int GetKeyPressed() const {
+            //The first key pressed this frame, 0 when there is none. Unlike raylib's, reading it does not remove it
+            return keyboardConsumed || keys.empty() ? 0 : keys.front();
+        }
+
+        void ConsumeMouse(){
+            mouseConsumed = true;
+        }
+
+        void ConsumeKeyboard(){
+            keyboardConsumed = true;
+        }
+    };
+
+    struct FontMemoryStats{
+        size_t fonts; // Distinct loaded fonts
+        size_t references; // Live handles across all fonts
+        size_t textureBytes; // Glyph atlases on the GPU
+        size_t cpuBytes; // Glyph images, rectangles and glyph info kept in RAM
+    };
+
+    class FontRegistry{
+        /* Loads every distinct (path, base size, codepoint set) once and shares it between FontHandles. The font is
+         * unloaded, and rtk's caches for it dropped, when its last handle goes away.*/
+    public:
+        struct Entry{
+            std::string path;
+            int baseSize;
+            std::vector<int> codepoints; // Empty means raylib's default set
+            Font font;
+            size_t references;
+        };
+
+    private:
+        typedef std::tuple<std::string,int,std::vector<int>> Key;
+        std::map<Key,Entry> m_entries;
+
+    public:
+        Entry *Acquire(const std::string &path, int baseSize, const int *codepoints = nullptr, int codepointCount = 0){
+            std::vector<int> codepointSet;
+            if(codepoints) codepointSet.assign(codepoints, codepoints + codepointCount);
+            Key key = {path, baseSize, codepointSet};
+
+            auto it = m_entries.find(key);
+            if(it == m_entries.end()){
+                Font font = Backend().LoadFont(path.c_str(), baseSize, codepointSet.empty() ? nullptr : codepointSet.data(), (int)codepointSet.size());
+                it = m_entries.insert({key, {path, baseSize, codepointSet, font, 0}}).first;
+            }
+            it->second.references++;
+            return &it->second;
+        }
+
+        void Retain(Entry *entry){
+            entry->references++;
+        }
+
+        void Release(Entry *entry){
+            if(--entry->references > 0) return;
+            if(Backend().IsReady()){ //After CloseWindow there is no GL context left, and at exit the caches may already be gone
+                ReleaseFontCaches(entry->font);
+                Backend().UnloadFont(entry->font);
+            }
+            m_entries.erase({entry->path, entry->baseSize, entry->codepoints});
+        }
+
+        [[nodiscard]] FontMemoryStats GetMemoryStats() const {
+            FontMemoryStats stats{};
+            for(auto &e : m_entries){
+                const Font &font = e.second.font;
+                stats.fonts++;
+                stats.references += e.second.references;
+                stats.textureBytes += GetPixelDataSize(font.texture.width, font.texture.height, font.texture.format);
+                stats.cpuBytes += font.glyphCount * (sizeof(GlyphInfo) + sizeof(Rectangle));
+                for(int i = 0; i < font.glyphCount; i++){
+                    const Image &image = font.glyphs[i].image;
+                    if(image.data) stats.cpuBytes += GetPixelDataSize(image.width, image.height, image.format);
+                }
+            }
+            return stats;
+        }
+    };
+
+    FontRegistry fontRegistry;
+
+    class FontHandle{
+        //Shared ownership of a font in the registry. Copying a handle adds a reference, destroying one releases it.
+        FontRegistry::Entry *m_entry = nullptr;
+
+    public:
+        FontHandle() = default;
+
+        explicit FontHandle(FontRegistry::Entry *entry) : m_entry(entry) {}
+
+        FontHandle(const FontHandle &other) : m_entry(other.m_entry){
+            if(m_entry) fontRegistry.Retain(m_entry);
+        }
+
+        FontHandle(FontHandle &&other) noexcept : m_entry(other.m_entry){
+            other.m_entry = nullptr;
+        }
+
+        FontHandle &operator=(FontHandle other){
+            std::swap(m_entry, other.m_entry);
+            return *this;
+        }
+
+        ~FontHandle(){
+            if(m_entry) fontRegistry.Release(m_entry);
+        }
+
+        [[nodiscard]] Font Get() const {
+            return m_entry ? m_entry->font : Font{};
+        }
+
+        [[nodiscard]] const std::string &GetPath() const {
+            static const std::string none;
+            return m_entry ? m_entry->path : none;
+        }
+
+        explicit operator bool() const {
+            return m_entry != nullptr;
+        }
+    };
+
+    FontHandle AcquireFont(const std::string &path, int baseSize, const int *codepoints = nullptr, int codepointCount = 0){
+        return FontHandle(fontRegistry.Acquire(path, baseSize, codepoints, codepointCount));
+    }
+
+    FontMemoryStats GetFontMemoryStats(){
+        return fontRegistry.GetMemoryStats();
+    }
 
     struct Theme{
         Color line[RTK_STATES_COUNT];
@@ -66,6 +432,7 @@ void JsonFromRectangle(json &j, Rectangle r){
         float lineWidth;
 
         Font font;
+        FontHandle fontHandle; // Keeps font loaded while any theme uses it, empty for fonts loaded outside the registry
 
         //operator overload for json
 
@@ -85,7 +452,7 @@ void JsonFromRectangle(json &j, Rectangle r){
                          theme.base[3].r,theme.base[3].g,theme.base[3].b,theme.base[3].a};
             temp["background"] = {theme.background.r,theme.background.g,theme.background.b,theme.background.a};
             temp["lineWidth"] = theme.lineWidth;
-            temp["font"] = "times.ttf";
+            temp["font"] = theme.fontHandle ? theme.fontHandle.GetPath() : "times.ttf";
             j += temp;
         }
 
@@ -102,7 +469,8 @@ void JsonFromRectangle(json &j, Rectangle r){
         temp.background = {j["background"][0],j["background"][1],j["background"][2],j["background"][3]};
         temp.lineWidth = j["lineWidth"];
         std::string fontFilename = j["font"];
-        temp.font = LoadFontEx(fontFilename.c_str(),64, nullptr,0);
+        temp.fontHandle = AcquireFont(fontFilename,64);
+        temp.font = temp.fontHandle.Get();
         return temp;
     }
 
@@ -141,7 +509,8 @@ void JsonFromRectangle(json &j, Rectangle r){
     Theme defaultTheme = {0};
 Theme LoadDefaultTheme(){
     if(defaultTheme.font.glyphCount == 0){
-        defaultTheme.font = LoadFontEx("times.ttf",64, nullptr,0);
+        defaultTheme.fontHandle = AcquireFont("times.ttf",64);
+        defaultTheme.font = defaultTheme.fontHandle.Get();
         defaultTheme.line[Normal] = BLACK;
         defaultTheme.line[Focused] = ColorAlpha(BLACK, 0.9f);
         defaultTheme.line[Pressed] = ColorTint(BLACK, GREEN);
@@ -159,122 +528,2286 @@ Theme LoadDefaultTheme(){
 
         defaultTheme.background = {220, 220, 220, 255};
 
-        defaultTheme.lineWidth = 5;
-    }
+        defaultTheme.lineWidth = 5;
+    }
+
+    return defaultTheme;
+}
+
+    bool ThemesEqual(const Theme &a, const Theme &b){
+        auto colorsEqual = [](Color x, Color y){return x.r == y.r && x.g == y.g && x.b == y.b && x.a == y.a;};
+        for(int i = 0; i < RTK_STATES_COUNT; i++){
+            if(!colorsEqual(a.line[i], b.line[i]) || !colorsEqual(a.text[i], b.text[i]) || !colorsEqual(a.base[i], b.base[i])) return false;
+        }
+        return colorsEqual(a.background, b.background) && a.lineWidth == b.lineWidth &&
+               a.font.texture.id == b.font.texture.id && a.font.glyphs == b.font.glyphs;
+    }
+
+    size_t ThemeHash(const Theme &theme){
+        //Agrees with ThemesEqual, equal themes hash the same
+        auto mix = [](size_t h, uint64_t v){return (h ^ v) * 1099511628211ull;};
+        auto pack = [](Color c){return (uint64_t)c.r | (uint64_t)c.g << 8 | (uint64_t)c.b << 16 | (uint64_t)c.a << 24;};
+        size_t h = 14695981039346656037ull;
+        for(int i = 0; i < RTK_STATES_COUNT; i++){
+            h = mix(h, pack(theme.line[i]) | pack(theme.text[i]) << 32);
+            h = mix(h, pack(theme.base[i]));
+        }
+        uint32_t lineWidth;
+        memcpy(&lineWidth, &theme.lineWidth, sizeof(lineWidth));
+        h = mix(h, pack(theme.background) | (uint64_t)lineWidth << 32);
+        h = mix(h, theme.font.texture.id);
+        return mix(h, (uint64_t)(uintptr_t)theme.font.glyphs);
+    }
+
+    typedef uint16_t ThemeId;
+
+#define THEME_TABLE_CAPACITY 65536 // Entries a 16 bit ThemeId can tell apart
+
+    ThemeId DefaultThemeId();
+
+    class ThemeTable{
+        /* Every theme in use lives here once and elements refer to it by a ThemeId, so thousands of elements share one
+         * copy and editing a theme restyles all of them. Entries made by Acquire count the elements using them and are
+         * emptied when the last one lets go, which also releases their font, and their id is reused. Entries made by
+         * Add or Intern are pinned and stay for the program, for ids the application keeps itself.*/
+        struct Entry{
+            Theme theme;
+            uint32_t users; // Elements holding the id
+            bool pinned;
+        };
+        std::deque<Entry> m_entries; // deque so references handed out by Get survive adding themes
+        std::vector<ThemeId> m_free; // Emptied entries, reused before the table grows
+        std::unordered_multimap<size_t,ThemeId> m_index; // ThemeHash of every live entry
+        uint32_t m_revision = 0; // Bumped by Set, lets cached drawings notice a restyle
+
+        ThemeId NewEntry(const Theme &theme, size_t hash, bool pinned){
+            ThemeId id;
+            if(!m_free.empty()){
+                id = m_free.back();
+                m_free.pop_back();
+                m_entries[id] = {theme, 0, pinned};
+            }
+            else{
+                //Ids would wrap past this and alias other entries, a full table hands out the default theme instead
+                assert(m_entries.size() < THEME_TABLE_CAPACITY && "ThemeTable is full");
+                if(m_entries.size() >= THEME_TABLE_CAPACITY) return DefaultThemeId();
+                id = (ThemeId)m_entries.size();
+                m_entries.push_back({theme, 0, pinned});
+            }
+            m_index.insert({hash, id});
+            return id;
+        }
+
+    public:
+        ThemeId Add(const Theme &theme){
+            //A pinned entry of its own, even when an identical one exists
+            return NewEntry(theme, ThemeHash(theme), true);
+        }
+
+        ThemeId Intern(const Theme &theme){
+            //Reuses an identical theme if there is one, pinning it
+            ThemeId id = Acquire(theme);
+            m_entries[id].pinned = true;
+            Release(id);
+            return id;
+        }
+
+        ThemeId Acquire(const Theme &theme){
+            //The id of an identical theme, or of a new entry, with one more user. Themes loaded from json are mostly duplicates
+            size_t hash = ThemeHash(theme);
+            auto range = m_index.equal_range(hash);
+            for(auto it = range.first; it != range.second; it++){
+                if(ThemesEqual(m_entries[it->second].theme, theme)) return Retain(it->second);
+            }
+            return Retain(NewEntry(theme, hash, false));
+        }
+
+        ThemeId Retain(ThemeId id){
+            m_entries[id].users++;
+            return id;
+        }
+
+        void Release(ThemeId id){
+            Entry &entry = m_entries[id];
+            if(--entry.users != 0 || entry.pinned) return;
+            Unindex(id);
+            entry.theme = Theme{}; // Drops the font handle
+            m_free.push_back(id);
+        }
+
+        [[nodiscard]] const Theme &Get(ThemeId id) const {
+            return m_entries[id].theme;
+        }
+
+        void Set(ThemeId id, const Theme &theme){
+            Unindex(id);
+            m_entries[id].theme = theme;
+            m_index.insert({ThemeHash(theme), id});
+            m_revision++;
+        }
+
+        [[nodiscard]] uint32_t GetRevision() const {return m_revision;}
+
+        [[nodiscard]] size_t Size() const {return m_entries.size() - m_free.size();}
+
+    private:
+        void Unindex(ThemeId id){
+            auto range = m_index.equal_range(ThemeHash(m_entries[id].theme));
+            for(auto it = range.first; it != range.second; it++){
+                if(it->second == id){
+                    m_index.erase(it);
+                    return;
+                }
+            }
+        }
+    };
+
+    ThemeTable themeTable;
+
+    ThemeId DefaultThemeId(){
+        static ThemeId id = themeTable.Add(LoadDefaultTheme());
+        return id;
+    }
+
+    ThemeId RegisterTheme(const Theme &theme){
+        //A pinned id, valid for the rest of the program
+        return themeTable.Intern(theme);
+    }
+
+    void UpdateTheme(ThemeId id, const Theme &theme){
+        //Every element using id picks up the change on its next Draw
+        themeTable.Set(id, theme);
+    }
+
+TextSettings LoadDefaultTextSettings(){
+    TextSettings settings = {
+            .horizontalAlign = TextAlign::Start,
+            .verticalAlign = TextAlign::Center,
+            .fontSize = 16,
+            .fontMargin = {0.25f,0.25f},
+            .spacing = GET_SPACING(settings.fontSize)
+    };
+    return settings;
+
+}
+
+#define GLYPH_TABLE_DIRECT_SIZE 512 // Codepoints below this (ASCII, Latin-1, Latin Extended-A/B) are a flat array lookup
+
+    struct GlyphTable{
+        /* Codepoint to glyph index for one loaded font. raylib's GetGlyphIndex scans every glyph, this is built once
+         * per font and answers with an array read for the Latin range and a hash lookup for everything else.
+         * Unknown codepoints map to the '?' glyph, the same fallback raylib uses.*/
+        const GlyphInfo *glyphs = nullptr; // The font this table was built for
+        int glyphCount = 0;
+        unsigned int textureId = 0;
+        int fallback = 0;
+        float lineSpacing = 0; // Vertical advance of '\n' as used by MeasureTextEx/DrawTextEx
+        int direct[GLYPH_TABLE_DIRECT_SIZE];
+        std::unordered_map<int,int> extended;
+
+        [[nodiscard]] int Index(int codepoint) const {
+            if(codepoint >= 0 && codepoint < GLYPH_TABLE_DIRECT_SIZE) return direct[codepoint];
+            auto it = extended.find(codepoint);
+            return it == extended.end() ? fallback : it->second;
+        }
+
+        [[nodiscard]] bool IsBuiltFor(const Font &font) const {
+            return glyphs == font.glyphs && glyphCount == font.glyphCount && textureId == font.texture.id;
+        }
+
+        void Build(const Font &font){
+            glyphs = font.glyphs;
+            glyphCount = font.glyphCount;
+            textureId = font.texture.id;
+            extended.clear();
+
+            fallback = 0;
+            for(int i = 0; i < font.glyphCount; i++){
+                if(font.glyphs[i].value == '?') fallback = i;
+            }
+            std::fill(std::begin(direct), std::end(direct), fallback);
+            for(int i = font.glyphCount - 1; i >= 0; i--){ //Backwards so the first glyph with a codepoint wins, like the scan
+                int codepoint = font.glyphs[i].value;
+                if(codepoint >= 0 && codepoint < GLYPH_TABLE_DIRECT_SIZE) direct[codepoint] = i;
+                else extended[codepoint] = i;
+            }
+            //raylib keeps the line spacing private, but measuring a lone newline at size 1 reveals it
+            lineSpacing = font.texture.id != 0 ? MeasureTextEx(font, "\n", 1, 0).y - 1 : 0;
+        }
+    };
+
+    class GlyphTableCache{
+        //Builds a GlyphTable the first time a font is used. Release a font's table when the font is unloaded.
+        std::unordered_map<const GlyphInfo*,GlyphTable> m_tables;
+        const GlyphTable *m_last = nullptr; // Most text is drawn with the same font as the previous call
+
+    public:
+        const GlyphTable &Get(const Font &font){
+            if(m_last && m_last->IsBuiltFor(font)) return *m_last;
+            GlyphTable &table = m_tables[font.glyphs];
+            if(!table.IsBuiltFor(font)) table.Build(font);
+            m_last = &table;
+            return table;
+        }
+
+        void Release(const Font &font){
+            m_tables.erase(font.glyphs);
+            m_last = nullptr;
+        }
+
+        void Clear(){
+            //Call after SetTextLineSpacing, every table caches the line spacing
+            m_tables.clear();
+            m_last = nullptr;
+        }
+
+        [[nodiscard]] size_t Size() const {return m_tables.size();}
+    };
+
+    GlyphTableCache glyphTables;
+
+    const GlyphTable &GetGlyphTable(const Font &font){
+        return glyphTables.Get(font);
+    }
+
+    int GetGlyphIndexFast(const Font &font, int codepoint){
+        return glyphTables.Get(font).Index(codepoint);
+    }
+
+    Vector2 MeasureTextFast(Font font, const char *text, float fontSize, float spacing){
+        //MeasureTextEx with the glyph lookups going through the font's GlyphTable
+        Vector2 textSize = {0, 0};
+        if(font.texture.id == 0 || text == nullptr) return textSize;
+        const GlyphTable &table = GetGlyphTable(font);
+
+        int maxGlyphsInLine = 0;
+        int glyphsInLine = 0;
+        float lineWidth = 0;
+        float maxLineWidth = 0;
+        float textHeight = fontSize;
+        float scaleFactor = fontSize / (float)font.baseSize;
+        for(int i = 0; text[i] != '\0';){
+            glyphsInLine++;
+            int codepointSize = 0;
+            int codepoint = GetCodepointNext(&text[i], &codepointSize);
+            i += codepointSize;
+            if(codepoint != '\n'){
+                int index = table.Index(codepoint);
+                if(font.glyphs[index].advanceX != 0) lineWidth += font.glyphs[index].advanceX;
+                else lineWidth += font.recs[index].width + font.glyphs[index].offsetX;
+            }
+            else{
+                maxLineWidth = std::max(maxLineWidth, lineWidth);
+                glyphsInLine = 0;
+                lineWidth = 0;
+                textHeight += table.lineSpacing;
+            }
+            maxGlyphsInLine = std::max(maxGlyphsInLine, glyphsInLine);
+        }
+        maxLineWidth = std::max(maxLineWidth, lineWidth);
+        textSize.x = maxLineWidth * scaleFactor + (float)((maxGlyphsInLine - 1) * spacing);
+        textSize.y = textHeight;
+        return textSize;
+    }
+
+    void DrawTextGlyphs(Font font, const char *text, Vector2 position, float fontSize, float spacing, Color tint){
+        //DrawTextEx with the glyph lookups going through the font's GlyphTable. Glyphs are drawn as in DrawTextCodepoint.
+        if(font.texture.id == 0){
+            DrawTextEx(font, text, position, fontSize, spacing, tint); //raylib substitutes its default font
+            return;
+        }
+        const GlyphTable &table = GetGlyphTable(font);
+        float scaleFactor = fontSize / (float)font.baseSize;
+        float padding = (float)font.glyphPadding;
+        Vector2 offset = {0, 0};
+        for(int i = 0; text[i] != '\0';){
+            int codepointSize = 0;
+            int codepoint = GetCodepointNext(&text[i], &codepointSize);
+            i += codepointSize;
+            if(codepoint == '\n'){
+                offset.y += table.lineSpacing;
+                offset.x = 0;
+                continue;
+            }
+            int index = table.Index(codepoint);
+            if(codepoint != ' ' && codepoint != '\t'){
+                Rectangle source = {font.recs[index].x - padding, font.recs[index].y - padding,
+                                    font.recs[index].width + 2 * padding, font.recs[index].height + 2 * padding};
+                Rectangle destination = {position.x + offset.x + (font.glyphs[index].offsetX - padding) * scaleFactor,
+                                         position.y + offset.y + (font.glyphs[index].offsetY - padding) * scaleFactor,
+                                         source.width * scaleFactor, source.height * scaleFactor};
+                DrawTexturePro(font.texture, source, destination, {0, 0}, 0, tint);
+            }
+            if(font.glyphs[index].advanceX == 0) offset.x += font.recs[index].width * scaleFactor + spacing;
+            else offset.x += font.glyphs[index].advanceX * scaleFactor + spacing;
+        }
+    }
+
+    class RaylibBackend : public RenderBackend{
+        //The default backend, a thin layer over raylib's own functions
+    public:
+        void DrawRectangle(Rectangle rect, Color color) override {::DrawRectangleRec(rect, color);}
+
+        void DrawRectangleLines(Rectangle rect, float thickness, Color color) override {::DrawRectangleLinesEx(rect, thickness, color);}
+
+        void DrawText(Font font, const char *text, Vector2 position, float fontSize, float spacing, Color tint) override {
+            DrawTextGlyphs(font, text, position, fontSize, spacing, tint);
+        }
+
+        void DrawTexture(Texture2D texture, Rectangle source, Rectangle destination, Color tint) override {
+            DrawTexturePro(texture, source, destination, {0, 0}, 0, tint);
+        }
+
+        void Clear(Color color) override {ClearBackground(color);}
+
+        void BeginScissor(int x, int y, int width, int height) override {BeginScissorMode(x, y, width, height);}
+
+        void EndScissor() override {EndScissorMode();}
+
+        RenderTexture2D LoadRenderTarget(int width, int height) override {
+            RenderTexture2D target = LoadRenderTexture(width, height);
+            if(!IsRenderTextureReady(target)) return {0};
+            return target;
+        }
+
+        void UnloadRenderTarget(RenderTexture2D target) override {UnloadRenderTexture(target);}
+
+        void BeginRenderTarget(RenderTexture2D target, Camera2D camera) override {
+            BeginTextureMode(target);
+            BeginMode2D(camera);
+        }
+
+        void EndRenderTarget() override {
+            EndMode2D();
+            EndTextureMode();
+        }
+
+        Font LoadFont(const char *path, int baseSize, const int *codepoints, int codepointCount) override {
+            return LoadFontEx(path, baseSize, const_cast<int*>(codepoints), codepointCount);
+        }
+
+        void UnloadFont(Font font) override {::UnloadFont(font);}
+
+        Vector2 MeasureText(Font font, const char *text, float fontSize, float spacing) override {
+            return MeasureTextFast(font, text, fontSize, spacing);
+        }
+
+        Vector2 GetMousePosition() override {return ::GetMousePosition();}
+
+        Vector2 GetMouseDelta() override {return ::GetMouseDelta();}
+
+        float GetMouseWheelMove() override {return ::GetMouseWheelMove();}
+
+        bool IsMouseButtonDown(int button) override {return ::IsMouseButtonDown(button);}
+
+        bool IsMouseButtonPressed(int button) override {return ::IsMouseButtonPressed(button);}
+
+        bool IsMouseButtonReleased(int button) override {return ::IsMouseButtonReleased(button);}
+
+        bool IsKeyDown(int key) override {return ::IsKeyDown(key);}
+
+        bool IsKeyPressed(int key) override {return ::IsKeyPressed(key);}
+
+        int GetKeyPressed() override {return ::GetKeyPressed();}
+
+        float GetFrameTime() override {return ::GetFrameTime();}
+
+        void Wake() override {
+#ifndef RTK_NO_GLFW_WAKE
+            glfwPostEmptyEvent();
+#endif
+        }
+
+        int GetScreenWidth() override {return ::GetScreenWidth();}
+
+        int GetScreenHeight() override {return ::GetScreenHeight();}
+
+        bool IsReady() override {return IsWindowReady();}
+    };
+
+    RenderBackend *DefaultBackend(){
+        //Never destroyed, fonts held by global themes are released through it during exit
+        static RenderBackend *backend = new RaylibBackend();
+        return backend;
+    }
+
+#define TEXT_MEASURE_CACHE_CAPACITY 2048 // The amount of measurements kept before the least recently used is evicted
+
+    struct TextMeasureCacheStats{
+        unsigned long long hits;
+        unsigned long long misses;
+        unsigned long long evictions;
+        size_t size;
+    };
+
+    class TextMeasureCache{
+        /* Memoizes MeasureTextFast. Entries are keyed on (font, string hash, font size, spacing) and the string itself
+         * is kept to rule out hash collisions. Since the text is part of the key, changing the text or the settings of
+         * an element simply misses and the stale entry ages out of the LRU list.*/
+        struct Entry{
+            unsigned int fontId;
+            size_t textHash;
+            float fontSize;
+            float spacing;
+            std::string text;
+            Vector2 size;
+        };
+        typedef std::list<Entry>::iterator EntryIterator;
+
+        std::list<Entry> m_entries; // Front is the most recently used
+        std::unordered_multimap<size_t,EntryIterator> m_lookup;
+        size_t m_capacity = TEXT_MEASURE_CACHE_CAPACITY;
+        TextMeasureCacheStats m_stats{};
+
+        static size_t KeyHash(unsigned int fontId, size_t textHash, float fontSize, float spacing){
+            size_t key = textHash;
+            key ^= std::hash<unsigned int>()(fontId) + 0x9e3779b9 + (key << 6) + (key >> 2);
+            key ^= std::hash<float>()(fontSize) + 0x9e3779b9 + (key << 6) + (key >> 2);
+            key ^= std::hash<float>()(spacing) + 0x9e3779b9 + (key << 6) + (key >> 2);
+            return key;
+        }
+
+        void Erase(EntryIterator entry){
+            auto range = m_lookup.equal_range(KeyHash(entry->fontId, entry->textHash, entry->fontSize, entry->spacing));
+            for(auto it = range.first; it != range.second; it++){
+                if(it->second == entry){
+                    m_lookup.erase(it);
+                    break;
+                }
+            }
+            m_entries.erase(entry);
+        }
+
+    public:
+        Vector2 Measure(Font font, const char *text, float fontSize, float spacing){
+            std::string_view view(text);
+            size_t textHash = std::hash<std::string_view>()(view);
+            size_t key = KeyHash(font.texture.id, textHash, fontSize, spacing);
+
+            auto range = m_lookup.equal_range(key);
+            for(auto it = range.first; it != range.second; it++){
+                Entry &entry = *it->second;
+                if(entry.fontId == font.texture.id && entry.fontSize == fontSize && entry.spacing == spacing && entry.text == view){
+                    m_entries.splice(m_entries.begin(), m_entries, it->second);
+                    m_stats.hits++;
+                    return entry.size;
+                }
+            }
+
+            m_stats.misses++;
+            Vector2 size = Backend().MeasureText(font, text, fontSize, spacing);
+            if(m_capacity == 0) return size;
+            m_entries.push_front({font.texture.id, textHash, fontSize, spacing, std::string(view), size});
+            m_lookup.insert({key, m_entries.begin()});
+            while(m_entries.size() > m_capacity){
+                Erase(std::prev(m_entries.end()));
+                m_stats.evictions++;
+            }
+            return size;
+        }
+
+        void Invalidate(Font font){
+            //Call when a font is unloaded, its texture id may be reused by the next font
+            for(auto it = m_entries.begin(); it != m_entries.end();){
+                auto next = std::next(it);
+                if(it->fontId == font.texture.id) Erase(it);
+                it = next;
+            }
+        }
+
+        void Clear(){
+            m_entries.clear();
+            m_lookup.clear();
+        }
+
+        void SetCapacity(size_t capacity){
+            m_capacity = capacity;
+            while(m_entries.size() > m_capacity){
+                Erase(std::prev(m_entries.end()));
+                m_stats.evictions++;
+            }
+        }
+
+        [[nodiscard]] size_t GetCapacity() const {return m_capacity;}
+
+        [[nodiscard]] TextMeasureCacheStats GetStats() const {
+            TextMeasureCacheStats stats = m_stats;
+            stats.size = m_entries.size();
+            return stats;
+        }
+
+        void ResetStats(){
+            m_stats = {};
+        }
+    };
+
+    TextMeasureCache textMeasureCache;
+
+    Vector2 MeasureTextCached(Font font, const char *text, float fontSize, float spacing){
+        return textMeasureCache.Measure(font, text, fontSize, spacing);
+    }
+
+    TextMeasureCacheStats GetTextMeasureCacheStats(){
+        return textMeasureCache.GetStats();
+    }
+
+    Rectangle RectangleUnion(Rectangle a, Rectangle b){
+        float left = std::min(a.x, b.x), top = std::min(a.y, b.y);
+        float right = std::max(a.x + a.width, b.x + b.width), bottom = std::max(a.y + a.height, b.y + b.height);
+        return {left, top, right - left, bottom - top};
+    }
+
+    bool RectangleContains(Rectangle outer, Rectangle inner){
+        return inner.x >= outer.x && inner.y >= outer.y &&
+               inner.x + inner.width <= outer.x + outer.width && inner.y + inner.height <= outer.y + outer.height;
+    }
+
+    enum class DrawCommandType {
+        Rectangle,
+        RectangleLines,
+        Text,
+        Texture
+    };
+
+    struct DrawCommand{
+        DrawCommandType type;
+        unsigned int textureId; // The batch a command belongs to, 0 for untextured shapes
+        Rectangle bounds; // Everything the command touches, used to keep overlapping commands in order
+        Rectangle rect; // The rectangle, outline or texture destination. Only x and y are used for text
+        Rectangle source; // Texture source rectangle
+        Color color;
+        float size; // Outline thickness or font size
+        float spacing;
+        Font font;
+        Texture2D texture;
+        size_t text; // Offset of the string in the draw list's text arena
+        size_t layer;
+    };
+
+    struct DrawListStats{
+        size_t commands; // Draw calls recorded
+        size_t batches; // Texture switches as submitted, each one makes rlgl flush its batch
+        size_t unsortedBatches; // Texture switches had the commands been submitted in recorded order
+        size_t submits; // Times the list was submitted, a scissor or render target change forces one
+    };
+
+    class DrawList{
+        /* Records draw calls and submits them grouped by texture, so shapes and the glyphs of each font atlas go out
+         * together instead of alternating. Painter's order is kept where it matters: a command is placed one layer
+         * above the highest layer holding an overlapping command with another texture, or joins the layer of an
+         * overlapping command with the same texture. Commands are then submitted by layer, then texture, then in
+         * recorded order. Anything that is not recorded (scissor, render targets, clearing) has to Flush first.*/
+        struct Bucket{
+            unsigned int textureId;
+            Rectangle bounds; // Union of the bounds of its commands, checked before the commands themselves
+            std::vector<Rectangle> commandBounds;
+
+            [[nodiscard]] bool Overlaps(Rectangle rect) const {
+                if(!CheckCollisionRecs(bounds, rect)) return false;
+                for(auto &r : commandBounds){
+                    if(CheckCollisionRecs(r, rect)) return true;
+                }
+                return false;
+            }
+        };
+
+        std::vector<DrawCommand> m_commands;
+        std::vector<std::vector<Bucket>> m_layers;
+        std::vector<size_t> m_order;
+        std::string m_textArena;
+        bool m_recording = false;
+        unsigned int m_lastRecordedTexture = 0;
+        DrawListStats m_stats = {0, 0, 0, 0};
+        DrawListStats m_lastStats = {0, 0, 0, 0};
+
+        size_t FindLayer(unsigned int textureId, Rectangle bounds){
+            for(size_t layer = m_layers.size(); layer-- > 0;){
+                bool sameTexture = false;
+                for(auto &bucket : m_layers[layer]){
+                    if(!bucket.Overlaps(bounds)) continue;
+                    if(bucket.textureId != textureId) return layer + 1;
+                    sameTexture = true;
+                }
+                if(sameTexture) return layer;
+            }
+            return 0;
+        }
+
+        void Execute(const DrawCommand &command){
+            switch(command.type){
+                case DrawCommandType::Rectangle:
+                    Backend().DrawRectangle(command.rect, command.color);
+                    break;
+                case DrawCommandType::RectangleLines:
+                    Backend().DrawRectangleLines(command.rect, command.size, command.color);
+                    break;
+                case DrawCommandType::Text:
+                    Backend().DrawText(command.font, &m_textArena[command.text], {command.rect.x, command.rect.y}, command.size, command.spacing, command.color);
+                    break;
+                case DrawCommandType::Texture:
+                    Backend().DrawTexture(command.texture, command.source, command.rect, command.color);
+                    break;
+            }
+        }
+
+    public:
+        void Begin(){
+            m_recording = true;
+            m_stats = {0, 0, 0, 0};
+        }
+
+        void End(){
+            Flush();
+            m_recording = false;
+            m_lastStats = m_stats;
+        }
+
+        [[nodiscard]] bool IsRecording() const {
+            return m_recording;
+        }
+
+        size_t AddText(const char *text){
+            size_t offset = m_textArena.size();
+            m_textArena.append(text);
+            m_textArena.push_back('\0');
+            return offset;
+        }
+
+        void Record(DrawCommand command){
+            if(!m_recording){
+                Execute(command);
+                return;
+            }
+            command.layer = FindLayer(command.textureId, command.bounds);
+            if(command.layer == m_layers.size()) m_layers.emplace_back();
+            auto &buckets = m_layers[command.layer];
+            auto bucket = std::find_if(buckets.begin(), buckets.end(), [&](const Bucket &b){return b.textureId == command.textureId;});
+            if(bucket == buckets.end()) bucket = buckets.insert(buckets.end(), {command.textureId, command.bounds, {}});
+            bucket->bounds = RectangleUnion(bucket->bounds, command.bounds);
+            bucket->commandBounds.push_back(command.bounds);
+
+            if(m_commands.empty() || command.textureId != m_lastRecordedTexture) m_stats.unsortedBatches++;
+            m_lastRecordedTexture = command.textureId;
+            m_stats.commands++;
+            m_commands.push_back(command);
+        }
+
+        void Flush(){
+            if(m_commands.empty()) return;
+            m_order.resize(m_commands.size());
+            for(size_t i = 0; i < m_order.size(); i++) m_order[i] = i;
+            std::stable_sort(m_order.begin(), m_order.end(), [&](size_t a, size_t b){
+                const DrawCommand &x = m_commands[a], &y = m_commands[b];
+                return x.layer != y.layer ? x.layer < y.layer : x.textureId < y.textureId;
+            });
+            unsigned int texture = 0;
+            for(size_t i = 0; i < m_order.size(); i++){
+                const DrawCommand &command = m_commands[m_order[i]];
+                if(i == 0 || command.textureId != texture) m_stats.batches++;
+                texture = command.textureId;
+                Execute(command);
+            }
+            m_stats.submits++;
+            m_commands.clear();
+            m_layers.clear();
+            m_textArena.clear();
+        }
+
+        [[nodiscard]] const DrawListStats &GetStats() const {
+            //The last frame recorded between Begin and End
+            return m_lastStats;
+        }
+    };
+
+    DrawList drawList;
+
+    std::vector<Vector2> originStack; // drawOrigin before each PushOrigin
+    Vector2 drawOrigin = {0, 0}; // Added to everything drawn, where the coordinates of what is being drawn start on screen
+
+    void PushOrigin(Vector2 offset){
+        //Until PopOrigin, drawing is positioned relative to offset, itself in the current coordinates
+        originStack.push_back(drawOrigin);
+        drawOrigin = {drawOrigin.x + offset.x, drawOrigin.y + offset.y};
+    }
+
+    void PopOrigin(){
+        drawOrigin = originStack.back();
+        originStack.pop_back();
+    }
+
+    Rectangle OffsetRect(Rectangle rect, Vector2 offset){
+        return {rect.x + offset.x, rect.y + offset.y, rect.width, rect.height};
+    }
+
+    void DrawRect(Rectangle rect, Color color){
+        DrawCommand command{};
+        command.type = DrawCommandType::Rectangle;
+        command.bounds = command.rect = OffsetRect(rect, drawOrigin);
+        command.color = color;
+        drawList.Record(command);
+    }
+
+    void DrawRectLines(Rectangle rect, float thickness, Color color){
+        DrawCommand command{};
+        command.type = DrawCommandType::RectangleLines;
+        command.bounds = command.rect = OffsetRect(rect, drawOrigin);
+        command.size = thickness;
+        command.color = color;
+        drawList.Record(command);
+    }
+
+    void DrawTexturedRect(Texture2D texture, Rectangle source, Rectangle destination, Color tint){
+        DrawCommand command{};
+        command.type = DrawCommandType::Texture;
+        command.textureId = texture.id;
+        command.bounds = command.rect = OffsetRect(destination, drawOrigin);
+        command.source = source;
+        command.texture = texture;
+        command.color = tint;
+        drawList.Record(command);
+    }
+
+    void DrawTextFast(Font font, const char *text, Vector2 position, float fontSize, float spacing, Color tint){
+        position = {position.x + drawOrigin.x, position.y + drawOrigin.y};
+        if(!drawList.IsRecording()){
+            Backend().DrawText(font, text, position, fontSize, spacing, tint);
+            return;
+        }
+        DrawCommand command{};
+        command.type = DrawCommandType::Text;
+        command.textureId = font.texture.id;
+        if(font.texture.id == 0){
+            command.bounds = {-1e9f, -1e9f, 2e9f, 2e9f}; //Drawn with raylib's default font, which can't be measured here
+        }
+        else{
+            //Glyph quads include the atlas padding and may start a little left of their advance
+            Vector2 size = MeasureTextCached(font, text, fontSize, spacing);
+            float pad = (float)(font.glyphPadding + 2) * fontSize / (float)font.baseSize;
+            command.bounds = {position.x - pad, position.y - pad, size.x + 2 * pad, size.y + 2 * pad};
+        }
+        command.rect = {position.x, position.y, 0, 0};
+        command.color = tint;
+        command.size = fontSize;
+        command.spacing = spacing;
+        command.font = font;
+        command.text = drawList.AddText(text);
+        drawList.Record(command);
+    }
+
+    DrawListStats GetDrawListStats(){
+        return drawList.GetStats();
+    }
+
+#define HEADLESS_TEXTURE_ID_BASE 0x40000000u // Texture ids handed out by headless backends, far from any GL id
+#define HEADLESS_KEY_COUNT 512
+
+    Font GenMonospaceFont(int baseSize, unsigned int textureId, const int *codepoints = nullptr, int codepointCount = 0){
+        /* A font without an atlas where every glyph is half as wide as it is tall. It has the glyph info and rectangles
+         * the measuring code needs, so layout runs without loading anything. Free it with UnloadMonospaceFont.*/
+        Font font{};
+        font.baseSize = baseSize;
+        font.glyphCount = codepoints ? codepointCount : 95; // raylib's default set, ' ' to '~'
+        font.texture.id = textureId;
+        font.glyphs = (GlyphInfo*)calloc(font.glyphCount, sizeof(GlyphInfo));
+        font.recs = (Rectangle*)calloc(font.glyphCount, sizeof(Rectangle));
+        int advance = std::max(baseSize / 2, 1);
+        for(int i = 0; i < font.glyphCount; i++){
+            font.glyphs[i].value = codepoints ? codepoints[i] : 32 + i;
+            font.glyphs[i].advanceX = advance;
+            font.recs[i] = {0, 0, (float)advance, (float)baseSize};
+        }
+        return font;
+    }
+
+    void UnloadMonospaceFont(Font font){
+        free(font.glyphs);
+        free(font.recs);
+    }
+
+    class HeadlessBackend : public RenderBackend{
+        /* Input, fonts and render target bookkeeping for backends without a window. Input is whatever the caller fed
+         * in since the last NextFrame, which also clears the pressed and released edges like raylib's event polling.*/
+    protected:
+        int m_width;
+        int m_height;
+        unsigned int m_nextTextureId = HEADLESS_TEXTURE_ID_BASE;
+        float m_frameTime = 1.0f / 60;
+        Vector2 m_mouse = {0, 0};
+        Vector2 m_mouseDelta = {0, 0};
+        float m_mouseWheel = 0;
+        std::array<bool,3> m_buttonDown{};
+        std::array<bool,3> m_buttonPressed{};
+        std::array<bool,3> m_buttonReleased{};
+        std::array<bool,HEADLESS_KEY_COUNT> m_keyDown{};
+        std::array<bool,HEADLESS_KEY_COUNT> m_keyPressed{};
+        std::deque<int> m_keyQueue;
+
+        static bool ValidKey(int key) {return key > 0 && key < HEADLESS_KEY_COUNT;}
+
+        static bool ValidButton(int button) {return button >= 0 && button < 3;}
+
+    public:
+        HeadlessBackend(int width, int height) : m_width(width), m_height(height) {}
+
+        void SetMousePosition(Vector2 position){
+            m_mouseDelta = {m_mouseDelta.x + position.x - m_mouse.x, m_mouseDelta.y + position.y - m_mouse.y};
+            m_mouse = position;
+        }
+
+        void ScrollMouseWheel(float move){
+            m_mouseWheel += move;
+        }
+
+        void PressMouseButton(int button){
+            if(!ValidButton(button)) return;
+            if(!m_buttonDown[button]) m_buttonPressed[button] = true;
+            m_buttonDown[button] = true;
+        }
+
+        void ReleaseMouseButton(int button){
+            if(!ValidButton(button)) return;
+            if(m_buttonDown[button]) m_buttonReleased[button] = true;
+            m_buttonDown[button] = false;
+        }
+
+        void PressKey(int key){
+            if(!ValidKey(key)) return;
+            if(!m_keyDown[key]){
+                m_keyPressed[key] = true;
+                m_keyQueue.push_back(key);
+            }
+            m_keyDown[key] = true;
+        }
+
+        void ReleaseKey(int key){
+            if(ValidKey(key)) m_keyDown[key] = false;
+        }
+
+        void SetFrameTime(float seconds){
+            m_frameTime = seconds;
+        }
+
+        void SetScreenSize(int width, int height){
+            m_width = width;
+            m_height = height;
+        }
+
+        virtual void NextFrame(){
+            m_mouseDelta = {0, 0};
+            m_mouseWheel = 0;
+            m_buttonPressed.fill(false);
+            m_buttonReleased.fill(false);
+            m_keyPressed.fill(false);
+            m_keyQueue.clear();
+        }
+
+        RenderTexture2D LoadRenderTarget(int width, int height) override {
+            RenderTexture2D target{};
+            target.id = target.texture.id = m_nextTextureId++;
+            target.texture.width = width;
+            target.texture.height = height;
+            target.texture.format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8;
+            return target;
+        }
+
+        void UnloadRenderTarget(RenderTexture2D target) override {}
+
+        Font LoadFont(const char *path, int baseSize, const int *codepoints, int codepointCount) override {
+            return GenMonospaceFont(baseSize, m_nextTextureId++, codepoints, codepointCount);
+        }
+
+        void UnloadFont(Font font) override {UnloadMonospaceFont(font);}
+
+        Vector2 MeasureText(Font font, const char *text, float fontSize, float spacing) override {
+            return MeasureTextFast(font, text, fontSize, spacing);
+        }
+
+        Vector2 GetMousePosition() override {return m_mouse;}
+
+        Vector2 GetMouseDelta() override {return m_mouseDelta;}
+
+        float GetMouseWheelMove() override {return m_mouseWheel;}
+
+        bool IsMouseButtonDown(int button) override {return ValidButton(button) && m_buttonDown[button];}
+
+        bool IsMouseButtonPressed(int button) override {return ValidButton(button) && m_buttonPressed[button];}
+
+        bool IsMouseButtonReleased(int button) override {return ValidButton(button) && m_buttonReleased[button];}
+
+        bool IsKeyDown(int key) override {return ValidKey(key) && m_keyDown[key];}
+
+        bool IsKeyPressed(int key) override {return ValidKey(key) && m_keyPressed[key];}
+
+        int GetKeyPressed() override {
+            if(m_keyQueue.empty()) return 0;
+            int key = m_keyQueue.front();
+            m_keyQueue.pop_front();
+            return key;
+        }
+
+        float GetFrameTime() override {return m_frameTime;}
+
+        int GetScreenWidth() override {return m_width;}
+
+        int GetScreenHeight() override {return m_height;}
+
+        bool IsReady() override {return true;}
+    };
+
+    struct NullBackendStats{
+        size_t clears;
+        size_t scissors;
+        size_t targets; // Render targets begun
+    };
+
+    class NullBackend : public HeadlessBackend{
+        /* Draws nothing and records every draw call, for running and timing widget code without a GPU. Text is
+         * kept in an arena, GetText resolves a recorded Text command to its string.*/
+        std::vector<DrawCommand> m_commands;
+        std::string m_textArena;
+        NullBackendStats m_stats = {0, 0, 0};
+
+        void Record(DrawCommandType type, Rectangle rect, Color color){
+            DrawCommand command{};
+            command.type = type;
+            command.bounds = command.rect = rect;
+            command.color = color;
+            m_commands.push_back(command);
+        }
+
+    public:
+        NullBackend(int width = 1600, int height = 900) : HeadlessBackend(width, height) {}
+
+        void DrawRectangle(Rectangle rect, Color color) override {Record(DrawCommandType::Rectangle, rect, color);}
+
+        void DrawRectangleLines(Rectangle rect, float thickness, Color color) override {
+            Record(DrawCommandType::RectangleLines, rect, color);
+            m_commands.back().size = thickness;
+        }
+
+        void DrawText(Font font, const char *text, Vector2 position, float fontSize, float spacing, Color tint) override {
+            Vector2 size = MeasureTextCached(font, text, fontSize, spacing);
+            Record(DrawCommandType::Text, {position.x, position.y, size.x, size.y}, tint);
+            DrawCommand &command = m_commands.back();
+            command.textureId = font.texture.id;
+            command.font = font;
+            command.size = fontSize;
+            command.spacing = spacing;
+            command.text = m_textArena.size();
+            m_textArena.append(text);
+            m_textArena.push_back('\0');
+        }
+
+        void DrawTexture(Texture2D texture, Rectangle source, Rectangle destination, Color tint) override {
+            Record(DrawCommandType::Texture, destination, tint);
+            m_commands.back().textureId = texture.id;
+            m_commands.back().texture = texture;
+            m_commands.back().source = source;
+        }
+
+        void Clear(Color color) override {m_stats.clears++;}
+
+        void BeginScissor(int x, int y, int width, int height) override {m_stats.scissors++;}
+
+        void EndScissor() override {}
+
+        void BeginRenderTarget(RenderTexture2D target, Camera2D camera) override {m_stats.targets++;}
+
+        void EndRenderTarget() override {}
+
+        [[nodiscard]] const std::vector<DrawCommand> &GetCommands() const {return m_commands;}
+
+        [[nodiscard]] const char *GetText(const DrawCommand &command) const {return &m_textArena[command.text];}
+
+        [[nodiscard]] const NullBackendStats &GetStats() const {return m_stats;}
+
+        void ClearCommands(){
+            m_commands.clear();
+            m_textArena.clear();
+            m_stats = {0, 0, 0};
+        }
+    };
+
+    class SoftwareBackend : public HeadlessBackend{
+        /* Rasterizes on the CPU into an RGBA buffer per render target, the screen being target 0. Rectangles are
+         * filled over the pixels whose centers they cover, glyphs are sampled from the glyph images raylib keeps
+         * when a TTF loads, and fonts without them (or textures this backend did not create) draw as boxes.*/
+        struct Surface{
+            int width;
+            int height;
+            std::vector<Color> pixels;
+        };
+
+        std::unordered_map<unsigned int,Surface> m_surfaces;
+        std::unordered_set<const GlyphInfo*> m_loadedFonts; // Fonts loaded from a file rather than generated
+        unsigned int m_target = 0;
+        Vector2 m_origin = {0, 0};
+        bool m_scissor = false;
+        int m_scissorRect[4] = {0, 0, 0, 0};
+
+        static void Blend(Color &destination, Color source){
+            int alpha = source.a;
+            if(alpha == 0) return;
+            destination.r = (unsigned char)((source.r * alpha + destination.r * (255 - alpha)) / 255);
+            destination.g = (unsigned char)((source.g * alpha + destination.g * (255 - alpha)) / 255);
+            destination.b = (unsigned char)((source.b * alpha + destination.b * (255 - alpha)) / 255);
+            destination.a = (unsigned char)(alpha + destination.a * (255 - alpha) / 255);
+        }
+
+        bool PixelRange(Rectangle rect, int *x0, int *y0, int *x1, int *y1){
+            //The pixels of the current target covered by rect, clipped to the target and the scissor
+            Surface &surface = m_surfaces[m_target];
+            *x0 = std::max((int)std::lround(rect.x - m_origin.x), 0);
+            *y0 = std::max((int)std::lround(rect.y - m_origin.y), 0);
+            *x1 = std::min((int)std::lround(rect.x + rect.width - m_origin.x), surface.width);
+            *y1 = std::min((int)std::lround(rect.y + rect.height - m_origin.y), surface.height);
+            if(m_scissor){
+                *x0 = std::max(*x0, m_scissorRect[0]);
+                *y0 = std::max(*y0, m_scissorRect[1]);
+                *x1 = std::min(*x1, m_scissorRect[0] + m_scissorRect[2]);
+                *y1 = std::min(*y1, m_scissorRect[1] + m_scissorRect[3]);
+            }
+            return *x0 < *x1 && *y0 < *y1;
+        }
+
+        void Fill(Rectangle rect, Color color){
+            int x0, y0, x1, y1;
+            if(!PixelRange(rect, &x0, &y0, &x1, &y1)) return;
+            Surface &surface = m_surfaces[m_target];
+            for(int y = y0; y < y1; y++){
+                for(int x = x0; x < x1; x++) Blend(surface.pixels[y * surface.width + x], color);
+            }
+        }
+
+        void DrawGlyph(const GlyphInfo &glyph, Rectangle destination, float scale, Color tint){
+            const Image &image = glyph.image;
+            if(image.data == nullptr || image.format != PIXELFORMAT_UNCOMPRESSED_GRAYSCALE){
+                Fill(destination, {tint.r, tint.g, tint.b, (unsigned char)(tint.a / 2)});
+                return;
+            }
+            int x0, y0, x1, y1;
+            if(!PixelRange(destination, &x0, &y0, &x1, &y1)) return;
+            Surface &surface = m_surfaces[m_target];
+            const unsigned char *alpha = (const unsigned char*)image.data;
+            for(int y = y0; y < y1; y++){
+                int sourceY = std::min((int)((y + m_origin.y - destination.y) / scale), image.height - 1);
+                for(int x = x0; x < x1; x++){
+                    int sourceX = std::min((int)((x + m_origin.x - destination.x) / scale), image.width - 1);
+                    if(sourceX < 0 || sourceY < 0) continue;
+                    Color color = tint;
+                    color.a = (unsigned char)(tint.a * alpha[sourceY * image.width + sourceX] / 255);
+                    Blend(surface.pixels[y * surface.width + x], color);
+                }
+            }
+        }
+
+    public:
+        SoftwareBackend(int width, int height) : HeadlessBackend(width, height) {
+            m_surfaces[0] = {width, height, std::vector<Color>((size_t)width * height, BLACK)};
+        }
+
+        void DrawRectangle(Rectangle rect, Color color) override {Fill(rect, color);}
+
+        void DrawRectangleLines(Rectangle rect, float thickness, Color color) override {
+            //The same four bands DrawRectangleLinesEx draws
+            Fill({rect.x, rect.y, rect.width, thickness}, color);
+            Fill({rect.x, rect.y + rect.height - thickness, rect.width, thickness}, color);
+            Fill({rect.x, rect.y + thickness, thickness, rect.height - 2 * thickness}, color);
+            Fill({rect.x + rect.width - thickness, rect.y + thickness, thickness, rect.height - 2 * thickness}, color);
+        }
+
+        void DrawText(Font font, const char *text, Vector2 position, float fontSize, float spacing, Color tint) override {
+            //Lays glyphs out exactly as DrawTextGlyphs does
+            if(font.glyphs == nullptr || font.texture.id == 0) return;
+            const GlyphTable &table = GetGlyphTable(font);
+            float scale = fontSize / (float)font.baseSize;
+            Vector2 offset = {0, 0};
+            for(int i = 0; text[i] != '\0';){
+                int codepointSize = 0;
+                int codepoint = GetCodepointNext(&text[i], &codepointSize);
+                i += codepointSize;
+                if(codepoint == '\n'){
+                    offset.y += table.lineSpacing;
+                    offset.x = 0;
+                    continue;
+                }
+                int index = table.Index(codepoint);
+                if(codepoint != ' ' && codepoint != '\t'){
+                    Rectangle destination = {position.x + offset.x + font.glyphs[index].offsetX * scale,
+                                             position.y + offset.y + font.glyphs[index].offsetY * scale,
+                                             font.recs[index].width * scale, font.recs[index].height * scale};
+                    DrawGlyph(font.glyphs[index], destination, scale, tint);
+                }
+                if(font.glyphs[index].advanceX == 0) offset.x += font.recs[index].width * scale + spacing;
+                else offset.x += font.glyphs[index].advanceX * scale + spacing;
+            }
+        }
+
+        void DrawTexture(Texture2D texture, Rectangle source, Rectangle destination, Color tint) override {
+            auto found = m_surfaces.find(texture.id);
+            if(found == m_surfaces.end() || texture.id == m_target){
+                Fill(destination, tint);
+                return;
+            }
+            //Render targets are stored the way they appear, the negative height rtk passes to undo OpenGL's flip
+            //draws them upright and a positive one flips them
+            const Surface &from = found->second;
+            int x0, y0, x1, y1;
+            if(!PixelRange(destination, &x0, &y0, &x1, &y1)) return;
+            Surface &surface = m_surfaces[m_target];
+            float sourceHeight = std::fabs(source.height);
+            for(int y = y0; y < y1; y++){
+                float v = (y + m_origin.y + 0.5f - destination.y) / destination.height;
+                if(source.height > 0) v = 1 - v;
+                int sourceY = std::clamp((int)(source.y + v * sourceHeight), 0, from.height - 1);
+                for(int x = x0; x < x1; x++){
+                    float u = (x + m_origin.x + 0.5f - destination.x) / destination.width;
+                    int sourceX = std::clamp((int)(source.x + u * source.width), 0, from.width - 1);
+                    Color color = from.pixels[sourceY * from.width + sourceX];
+                    color = {(unsigned char)(color.r * tint.r / 255), (unsigned char)(color.g * tint.g / 255),
+                             (unsigned char)(color.b * tint.b / 255), (unsigned char)(color.a * tint.a / 255)};
+                    Blend(surface.pixels[y * surface.width + x], color);
+                }
+            }
+        }
+
+        void Clear(Color color) override {
+            //Like glClear, the scissor limits what is cleared
+            Surface &surface = m_surfaces[m_target];
+            int x0 = 0, y0 = 0, x1 = surface.width, y1 = surface.height;
+            if(m_scissor){
+                x0 = std::max(x0, m_scissorRect[0]);
+                y0 = std::max(y0, m_scissorRect[1]);
+                x1 = std::min(x1, m_scissorRect[0] + m_scissorRect[2]);
+                y1 = std::min(y1, m_scissorRect[1] + m_scissorRect[3]);
+            }
+            for(int y = y0; y < y1; y++){
+                for(int x = x0; x < x1; x++) surface.pixels[y * surface.width + x] = color;
+            }
+        }
+
+        void BeginScissor(int x, int y, int width, int height) override {
+            m_scissor = true;
+            m_scissorRect[0] = x;
+            m_scissorRect[1] = y;
+            m_scissorRect[2] = width;
+            m_scissorRect[3] = height;
+        }
+
+        void EndScissor() override {m_scissor = false;}
+
+        RenderTexture2D LoadRenderTarget(int width, int height) override {
+            RenderTexture2D target = HeadlessBackend::LoadRenderTarget(width, height);
+            m_surfaces[target.texture.id] = {width, height, std::vector<Color>((size_t)width * height, BLANK)};
+            return target;
+        }
+
+        void UnloadRenderTarget(RenderTexture2D target) override {m_surfaces.erase(target.texture.id);}
+
+        void BeginRenderTarget(RenderTexture2D target, Camera2D camera) override {
+            m_target = target.texture.id;
+            m_origin = camera.target;
+        }
+
+        void EndRenderTarget() override {
+            m_target = 0;
+            m_origin = {0, 0};
+        }
+
+        Font LoadFont(const char *path, int baseSize, const int *codepoints, int codepointCount) override {
+            //TTF and OTF files are rasterized on the CPU, anything else gets a generated monospace font
+            int dataSize = 0;
+            unsigned char *data = path ? LoadFileData(path, &dataSize) : nullptr;
+            GlyphInfo *glyphs = data ? LoadFontData(data, dataSize, baseSize, const_cast<int*>(codepoints), codepointCount, FONT_DEFAULT) : nullptr;
+            if(data) UnloadFileData(data);
+            if(glyphs == nullptr) return HeadlessBackend::LoadFont(path, baseSize, codepoints, codepointCount);
+
+            Font font{};
+            font.baseSize = baseSize;
+            font.glyphCount = codepoints ? codepointCount : 95;
+            font.glyphPadding = 0;
+            font.glyphs = glyphs;
+            Image atlas = GenImageFontAtlas(font.glyphs, &font.recs, font.glyphCount, baseSize, 0, 0);
+            UnloadImage(atlas);
+            font.texture.id = m_nextTextureId++;
+            m_loadedFonts.insert(font.glyphs);
+            return font;
+        }
+
+        void UnloadFont(Font font) override {
+            if(m_loadedFonts.erase(font.glyphs)){
+                UnloadFontData(font.glyphs, font.glyphCount);
+                free(font.recs);
+            }
+            else{
+                UnloadMonospaceFont(font);
+            }
+        }
+
+        [[nodiscard]] Color GetPixel(int x, int y, unsigned int target = 0) {
+            Surface &surface = m_surfaces[target];
+            return surface.pixels[y * surface.width + x];
+        }
+
+        bool WritePPM(const char *path, unsigned int target = 0){
+            //Binary PPM of a target's colors, alpha is dropped
+            FILE *file = fopen(path, "wb");
+            if(!file) return false;
+            Surface &surface = m_surfaces[target];
+            fprintf(file, "P6\n%d %d\n255\n", surface.width, surface.height);
+            for(auto &pixel : surface.pixels){
+                unsigned char rgb[3] = {pixel.r, pixel.g, pixel.b};
+                fwrite(rgb, 1, 3, file);
+            }
+            fclose(file);
+            return true;
+        }
+    };
+
+    int GetGlyphAdvance(Font font, int codepoint){
+        //Unscaled horizontal advance of a glyph, the same metric MeasureTextEx sums up
+        int index = GetGlyphIndexFast(font, codepoint);
+        if(font.glyphs[index].advanceX != 0) return font.glyphs[index].advanceX;
+        return font.recs[index].width + font.glyphs[index].offsetX;
+    }
+
+    void FitFontSizeToRectangle(Font font, const char *text, TextSettings *textSettings, Rectangle rectangle, float minimumFontSize = 0) {
+        /* Gives the same result as stepping down from rectangle.height 2px at a time until the text fits, but in a
+         * handful of measurements. Text width scales linearly with the font size (spacing is size/16 past 16px) and
+         * height is the font size plus a constant line spacing, so the first measurement gives a direct estimate of the
+         * fitting step. The estimate is then checked against its neighbour and, if it was off, bracketed and bisected.
+         * Step k means fontSize = rectangle.height - 2k. Step 0 keeps the current spacing, like the old loop did.*/
+        float maxWidth = rectangle.width * (1 - 2 * textSettings->fontMargin.x);
+        float maxHeight = rectangle.height * (1 - 2 * textSettings->fontMargin.y);
+        float startSize = rectangle.height;
+
+        auto fits = [&](Vector2 measuredSize){
+            return !(measuredSize.x > maxWidth || measuredSize.y > maxHeight);
+        };
+        auto fitsAtStep = [&](long step){
+            float size = startSize - 2 * (float)step;
+            return fits(MeasureTextCached(font, text, size, GET_SPACING(size)));
+        };
+
+        textSettings->fontSize = startSize;
+        Vector2 measuredSize = MeasureTextCached(font, text, textSettings->fontSize, textSettings->spacing);
+        if(!fits(measuredSize)){
+            float estimate = startSize;
+            if(measuredSize.x > maxWidth && measuredSize.x > 0) estimate = std::min(estimate, maxWidth * startSize / measuredSize.x);
+            if(measuredSize.y > maxHeight) estimate = std::min(estimate, maxHeight - (measuredSize.y - startSize));
+            long step = std::isfinite(estimate) ? (long)std::ceil((startSize - estimate) / 2) : 1;
+            step = std::max(step, 1L);
+
+            long low, high; // Step low never fits, step high always fits
+            long stride = 1;
+            if(fitsAtStep(step)){
+                high = step;
+                low = std::max(high - stride, 0L);
+                while(low > 0 && fitsAtStep(low)){
+                    high = low;
+                    stride *= 2;
+                    low = std::max(high - stride, 0L);
+                }
+            }
+            else{
+                low = step;
+                high = low + stride;
+                while(!fitsAtStep(high)){
+                    low = high;
+                    stride *= 2;
+                    high = low + stride;
+                }
+            }
+            while(high - low > 1){
+                long middle = low + (high - low) / 2;
+                if(fitsAtStep(middle)) high = middle;
+                else low = middle;
+            }
+
+            textSettings->fontSize = startSize - 2 * (float)high;
+            textSettings->spacing = GET_SPACING(textSettings->fontSize);
+        }
+        if(textSettings->fontSize < minimumFontSize) {
+            textSettings->fontSize = minimumFontSize;
+            textSettings->spacing = GET_SPACING(textSettings->fontSize);
+        }
+    }
+
+    void FindMaxFontSize(const char *text, TextSettings *textSettings, Rectangle rectangle, const Theme &theme, float minimumFontSize = 0) {
+        FitFontSizeToRectangle(theme.font, text, textSettings, rectangle, minimumFontSize);
+    }
+
+    void FindMaxFontSizeLinear(const char *text, TextSettings *textSettings, Rectangle rectangle, const Theme &theme, float minimumFontSize = 0) {
+        //The original shrink loop, kept as the reference for BenchmarkFindMaxFontSize
+        textSettings->fontSize = rectangle.height;
+
+        Vector2 measuredSize = MeasureTextCached(theme.font, text, textSettings->fontSize, textSettings->spacing);
+        while (measuredSize.x > rectangle.width * (1 - 2 * textSettings->fontMargin.x) ||
+               measuredSize.y > rectangle.height * (1 - 2 * textSettings->fontMargin.y)) {
+            textSettings->fontSize -= 2;
+            textSettings->spacing = GET_SPACING(textSettings->fontSize);
+            measuredSize = MeasureTextCached(theme.font, text, textSettings->fontSize, textSettings->spacing);
+        }
+        if(textSettings->fontSize < minimumFontSize) {
+            textSettings->fontSize = minimumFontSize;
+            textSettings->spacing = GET_SPACING(textSettings->fontSize);
+        }
+    }
+
+    void BenchmarkFindMaxFontSize(const char *text, Rectangle rectangle, const Theme &theme, int iterations = 1000, FILE *stream = stdout){
+        //Times the linear shrink loop against the solver. The measurement cache is emptied and disabled before the runs
+        //so both sides pay for every MeasureTextEx call, afterwards its capacity is restored but it stays empty.
+        size_t capacity = textMeasureCache.GetCapacity();
+        textMeasureCache.SetCapacity(0);
+
+        TextSettings linear = LoadDefaultTextSettings();
+        TextSettings solver = LoadDefaultTextSettings();
+        auto misses = GetTextMeasureCacheStats().misses;
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < iterations; i++){
+            linear = LoadDefaultTextSettings();
+            FindMaxFontSizeLinear(text, &linear, rectangle, theme);
+        }
+        auto linearTime = std::chrono::steady_clock::now() - start;
+        auto linearMeasurements = GetTextMeasureCacheStats().misses - misses;
+
+        misses = GetTextMeasureCacheStats().misses;
+        start = std::chrono::steady_clock::now();
+        for(int i = 0; i < iterations; i++){
+            solver = LoadDefaultTextSettings();
+            FindMaxFontSize(text, &solver, rectangle, theme);
+        }
+        auto solverTime = std::chrono::steady_clock::now() - start;
+        auto solverMeasurements = GetTextMeasureCacheStats().misses - misses;
+
+        textMeasureCache.SetCapacity(capacity);
+
+        fprintf(stream,"FindMaxFontSize: \"%s\" in %f x %f, %d iterations\n",text,rectangle.width,rectangle.height,iterations);
+        fprintf(stream,"Linear: %f ms, %llu measurements per call, font size %f\n",
+                std::chrono::duration<double,std::milli>(linearTime).count(),linearMeasurements / iterations,linear.fontSize);
+        fprintf(stream,"Solver: %f ms, %llu measurements per call, font size %f\n",
+                std::chrono::duration<double,std::milli>(solverTime).count(),solverMeasurements / iterations,solver.fontSize);
+        if(linear.fontSize != solver.fontSize || linear.spacing != solver.spacing) fprintf(stream,"Results differ\n");
+    }
+
+    void DrawTextInRectangle(const char *text, Rectangle rectangle, const Theme &theme, TextSettings textSettings, GuiElementState state = Normal, bool drawOutline = false){
+        Vector2 offset = {rectangle.x, rectangle.y};
+        Vector2 textSize = MeasureTextCached(theme.font, text, textSettings.fontSize, textSettings.spacing);
+
+        switch(textSettings.horizontalAlign){
+            case TextAlign::Start:
+                offset.x += rectangle.width * textSettings.fontMargin.x;
+                break;
+            case TextAlign::Center:
+                offset.x +=  rectangle.width / 2 - textSize.x / 2;
+                break;
+            case TextAlign::End:
+                offset.x += rectangle.width - textSize.x - textSettings.fontMargin.x * rectangle.width;
+                break;
+        }
+        switch(textSettings.verticalAlign){
+            case TextAlign::Start:
+                offset.y += rectangle.height * textSettings.fontMargin.y;
+                break;
+            case TextAlign::Center:
+                offset.y += rectangle.height / 2 - textSize.y / 2;
+                break;
+            case TextAlign::End:
+                offset.y += rectangle.height - textSize.y - textSettings.fontMargin.y * rectangle.height;
+                break;
+        }
+        DrawTextFast(theme.font, text, offset, textSettings.fontSize, textSettings.spacing, theme.text[state]);
+        if(drawOutline) DrawRectLines({offset.x,offset.y,textSize.x,textSize.y},1,GREEN);
+
+    }
+
+    struct LargestGlyph{
+        unsigned char character; // The first byte accepted by the filter with the widest glyph
+        int advance; // Its unscaled advance
+    };
+
+    class LargestGlyphCache{
+        /* The widest glyph accepted by a filter only depends on the font and the filter, so the 255-byte scan runs once
+         * per (font, filter) pair. Release a font's entries when the font is unloaded.*/
+        struct Key{
+            const GlyphInfo *glyphs;
+            unsigned int textureId;
+            CharacterFilter filter;
+
+            bool operator<(const Key &other) const {
+                return std::tie(glyphs, textureId, filter) < std::tie(other.glyphs, other.textureId, other.filter);
+            }
+        };
+        std::map<Key,LargestGlyph> m_entries;
+
+        static LargestGlyph Scan(Font font, const CharacterFilter &filter){
+            const GlyphTable &table = GetGlyphTable(font);
+            LargestGlyph largest = {0, 0};
+            for(int key = 0; key < 255; key++){
+                if(key == '\n' || !filter.Contains(key)) continue;
+                int index = table.Index(key);
+                int width;
+                if(font.glyphs[index].advanceX != 0){
+                    width = font.glyphs[index].advanceX;
+                }
+                else{
+                    width = font.recs[index].width + font.glyphs[index].offsetX;
+                }
+                if(width > largest.advance){
+                    largest = {(unsigned char)key, width};
+                }
+            }
+            return largest;
+        }
+
+    public:
+        LargestGlyph Get(Font font, const CharacterFilter &filter){
+            Key key = {font.glyphs, font.texture.id, filter};
+            auto it = m_entries.find(key);
+            if(it != m_entries.end()) return it->second;
+            LargestGlyph largest = Scan(font, filter);
+            m_entries.insert({key, largest});
+            return largest;
+        }
+
+        void Release(Font font){
+            for(auto it = m_entries.begin(); it != m_entries.end();){
+                if(it->first.glyphs == font.glyphs) it = m_entries.erase(it);
+                else it++;
+            }
+        }
+
+        void Clear(){
+            m_entries.clear();
+        }
+    };
+
+    LargestGlyphCache largestGlyphs;
+
+    void ReleaseFontCaches(Font font){
+        textMeasureCache.Invalidate(font);
+        largestGlyphs.Release(font);
+        glyphTables.Release(font);
+    }
+
+    LargestGlyph FindLargestGlyph(Font font, const CharacterFilter &filter = AsciiFilter){
+        return largestGlyphs.Get(font, filter);
+    }
+
+    int FindLargestCharacterSize(Font font, const CharacterFilter &filter = AsciiFilter){
+        return FindLargestGlyph(font, filter).advance;
+    }
+
+    unsigned char FindLargestCharacter(Font font, const CharacterFilter &filter = AsciiFilter){
+        return FindLargestGlyph(font, filter).character;
+    }
+
+    void FitFontSizeToGlyphRun(Font font, int advance, int glyphCount, TextSettings *textSettings, Rectangle rectangle, float minimumFontSize = 0) {
+        /* FitFontSizeToRectangle for a single line of glyphCount glyphs that are all advance wide, without measuring.
+         * Its width is glyphCount * advance * size / baseSize + (glyphCount - 1) * spacing, computed in the same order as
+         * MeasureTextEx so the result matches measuring the repeated string. Width is continuous and increasing in the
+         * size (spacing is 1 below 16px and size/16 above), so it is solved directly and then nudged onto the 2px grid.*/
+        float maxWidth = rectangle.width * (1 - 2 * textSettings->fontMargin.x);
+        float maxHeight = rectangle.height * (1 - 2 * textSettings->fontMargin.y);
+        float startSize = rectangle.height;
+        float runAdvance = (float)(glyphCount * advance);
+
+        auto fits = [&](float size, float spacing){
+            float width = runAdvance * (size / (float)font.baseSize) + (float)(glyphCount - 1) * spacing;
+            return !(width > maxWidth || size > maxHeight);
+        };
+        auto fitsAtStep = [&](long step){
+            float size = startSize - 2 * (float)step;
+            return fits(size, GET_SPACING(size));
+        };
+
+        textSettings->fontSize = startSize;
+        if(!fits(startSize, textSettings->spacing)){
+            float sizeAdvance = runAdvance / (float)font.baseSize; // Width per pixel of font size, without spacing
+            float estimate = maxWidth / (sizeAdvance + (float)(glyphCount - 1) / SPACING);
+            if(estimate < SPACING) estimate = (maxWidth - (float)(glyphCount - 1)) / sizeAdvance;
+            estimate = std::min(estimate, maxHeight);
+            if(!std::isfinite(estimate)){
+                //Zero width glyphs whose spacing alone overflows never fit, settle for the minimum
+                textSettings->fontSize = minimumFontSize;
+                textSettings->spacing = GET_SPACING(textSettings->fontSize);
+                return;
+            }
+
+            long step = std::max((long)std::ceil((startSize - estimate) / 2), 1L);
+            while(step > 1 && fitsAtStep(step - 1)) step--;
+            while(!fitsAtStep(step)) step++;
+
+            textSettings->fontSize = startSize - 2 * (float)step;
+            textSettings->spacing = GET_SPACING(textSettings->fontSize);
+        }
+        if(textSettings->fontSize < minimumFontSize) {
+            textSettings->fontSize = minimumFontSize;
+            textSettings->spacing = GET_SPACING(textSettings->fontSize);
+        }
+    }
+
+#define RENDER_CACHE_BUDGET (64 * 1024 * 1024) // Bytes of render textures windows may hold for retained drawing
+
+    struct RenderCacheStats{
+        size_t budget;
+        size_t used;
+        size_t textures;
+        size_t renders; // Times a cache was redrawn
+        size_t blits; // Times a cache was drawn instead of its contents
+    };
+
+    class RenderCacheBudget{
+        /* Accounts for the render textures held by retained windows. A window that cannot reserve room for its texture
+         * draws in immediate mode until enough is freed or the budget is raised.*/
+        RenderCacheStats m_stats = {RENDER_CACHE_BUDGET, 0, 0, 0, 0};
+
+    public:
+        bool Reserve(size_t bytes){
+            if(m_stats.used + bytes > m_stats.budget) return false;
+            m_stats.used += bytes;
+            m_stats.textures++;
+            return true;
+        }
+
+        void Free(size_t bytes){
+            m_stats.used -= bytes;
+            m_stats.textures--;
+        }
+
+        void CountRender(){m_stats.renders++;}
+
+        void CountBlit(){m_stats.blits++;}
+
+        void SetBudget(size_t bytes){m_stats.budget = bytes;}
+
+        [[nodiscard]] const RenderCacheStats &GetStats() const {return m_stats;}
+    };
+
+    RenderCacheBudget renderCacheBudget;
+
+    void SetRenderCacheBudget(size_t bytes){
+        //Textures already allocated are kept, the new budget applies to the next allocation
+        renderCacheBudget.SetBudget(bytes);
+    }
+
+    RenderCacheStats GetRenderCacheStats(){
+        return renderCacheBudget.GetStats();
+    }
+
+    struct RenderTargetFrame{
+        RenderTexture2D target; // id 0 for the screen
+        Camera2D camera;
+        bool scissor; // Whether scissorRect is applied while this target is current
+        Rectangle scissorRect; // In screen coordinates (drawOrigin applied), not the target's pixels
+    };
+
+    std::vector<RenderTargetFrame> renderTargetStack;
+    RenderTargetFrame screenTarget = {{0}, {{0,0}, {0,0}, 0, 1}, false, {0,0,0,0}};
+
+    RenderTargetFrame &CurrentRenderTarget(){
+        return renderTargetStack.empty() ? screenTarget : renderTargetStack.back();
+    }
+
+    void ApplyScissor(const RenderTargetFrame &frame){
+        Rectangle r = frame.scissorRect;
+        Backend().BeginScissor((int)std::floor(r.x - frame.camera.target.x), (int)std::floor(r.y - frame.camera.target.y),
+                         std::max((int)std::ceil(r.width), 0), std::max((int)std::ceil(r.height), 0));
+    }
+
+    void BeginScissor(Rectangle rect){
+        //Scissor on the current render target, kept across targets pushed on top of it
+        drawList.Flush();
+        RenderTargetFrame &frame = CurrentRenderTarget();
+        frame.scissor = true;
+        frame.scissorRect = rect;
+        ApplyScissor(frame);
+    }
+
+    void EndScissor(){
+        drawList.Flush();
+        CurrentRenderTarget().scissor = false;
+        Backend().EndScissor();
+    }
+
+    void BeginRenderTarget(RenderTexture2D target, Vector2 origin){
+        /* raylib's texture mode does not nest, so the enclosing target is ended here and restarted by EndRenderTarget.
+         * origin is the screen position that lands on the texture's top left corner, which lets elements keep
+         * drawing at their screen coordinates. A scissor set on the enclosing target is lifted until then.*/
+        drawList.Flush();
+        if(CurrentRenderTarget().scissor) Backend().EndScissor();
+        if(!renderTargetStack.empty()) Backend().EndRenderTarget();
+        Camera2D camera = {{0,0}, origin, 0, 1};
+        renderTargetStack.push_back({target, camera, false, {0,0,0,0}});
+        Backend().BeginRenderTarget(target, camera);
+    }
+
+    void EndRenderTarget(){
+        drawList.Flush();
+        if(CurrentRenderTarget().scissor) Backend().EndScissor();
+        Backend().EndRenderTarget();
+        renderTargetStack.pop_back();
+        if(!renderTargetStack.empty()) Backend().BeginRenderTarget(renderTargetStack.back().target, renderTargetStack.back().camera);
+        if(CurrentRenderTarget().scissor) ApplyScissor(CurrentRenderTarget());
+    }
+
+    struct CullStats{
+        size_t drawn; // Elements drawn through DrawClipped
+        size_t culled; // Elements skipped because they were outside the clip rectangle
+    };
+
+    CullStats cullStats = {0, 0};
+
+    struct ClipFrame{
+        bool scissor; // The scissor state of the render target before PushClip
+        Rectangle scissorRect;
+    };
+
+    std::vector<ClipFrame> clipStack;
+
+    Rectangle ScreenClipRect(){
+        //Where drawing is visible on the current target, in screen coordinates
+        RenderTargetFrame &frame = CurrentRenderTarget();
+        if(frame.scissor) return frame.scissorRect;
+        if(frame.target.id == 0) return {0, 0, (float)Backend().GetScreenWidth(), (float)Backend().GetScreenHeight()};
+        return {frame.camera.target.x, frame.camera.target.y, (float)frame.target.texture.width, (float)frame.target.texture.height};
+    }
+
+    Rectangle CurrentClipRect(){
+        //ScreenClipRect in the coordinates elements draw in
+        return OffsetRect(ScreenClipRect(), {-drawOrigin.x, -drawOrigin.y});
+    }
+
+    void PushClip(Rectangle rect){
+        //Clips to rect inside whatever is clipped already. Pops must happen on the render target of the push
+        RenderTargetFrame &frame = CurrentRenderTarget();
+        clipStack.push_back({frame.scissor, frame.scissorRect});
+        rect = OffsetRect(rect, drawOrigin);
+        Rectangle clip = GetCollisionRec(ScreenClipRect(), rect);
+        if(clip.width <= 0 || clip.height <= 0) clip = {rect.x, rect.y, 0, 0};
+        BeginScissor(clip);
+    }
+
+    void PopClip(){
+        ClipFrame previous = clipStack.back();
+        clipStack.pop_back();
+        if(previous.scissor) BeginScissor(previous.scissorRect);
+        else EndScissor();
+    }
+
+#define DAMAGE_MAX_RECTS 64 // Past this many pending rectangles, damage collapses into their bounding box
+#define DAMAGE_FULL_REDRAW_RATIO 0.6f // Merged damage covering more than this fraction of the screen redraws all of it
+
+    struct DamageStats{
+        size_t reported; // Rectangles reported since the last frame
+        size_t redrawn; // Rectangles left after merging
+        float coverage; // Fraction of the screen redrawn
+    };
+
+    class DamageTracker{
+        /* Collects the screen rectangles elements invalidated since the last frame. Merge turns them into a few
+         * disjoint regions, overlapping or touching rectangles are combined and enough damage becomes a full redraw.*/
+        std::vector<Rectangle> m_rects;
+        bool m_full = true; // Nothing has been drawn yet
+        size_t m_reported = 0;
+
+    public:
+        void Add(Rectangle rect){
+            if(m_full || rect.width <= 0 || rect.height <= 0) return;
+            m_reported++;
+            if(m_rects.size() >= DAMAGE_MAX_RECTS){
+                Rectangle bounds = rect;
+                for(auto &r : m_rects) bounds = RectangleUnion(bounds, r);
+                m_rects.assign(1, bounds);
+                return;
+            }
+            m_rects.push_back(rect);
+        }
+
+        void AddAll(){
+            m_full = true;
+            m_rects.clear();
+        }
+
+        [[nodiscard]] bool Empty() const {
+            return !m_full && m_rects.empty();
+        }
+
+        std::vector<Rectangle> Merge(Rectangle screen, DamageStats *stats = nullptr){
+            std::vector<Rectangle> merged;
+            if(m_full){
+                merged.push_back(screen);
+            }
+            else{
+                for(auto &r : m_rects){
+                    Rectangle clipped = GetCollisionRec(r, screen);
+                    if(clipped.width > 0 && clipped.height > 0) merged.push_back(clipped);
+                }
+                bool combined = true;
+                while(combined){
+                    //A grown rectangle may touch ones already passed, so repeat until a pass combines nothing
+                    combined = false;
+                    for(size_t i = 0; i < merged.size(); i++){
+                        for(size_t j = i + 1; j < merged.size(); j++){
+                            Rectangle a = merged[i], b = merged[j];
+                            if(a.x <= b.x + b.width && b.x <= a.x + a.width && a.y <= b.y + b.height && b.y <= a.y + a.height){
+                                merged[i] = RectangleUnion(a, b);
+                                merged.erase(merged.begin() + j);
+                                j--;
+                                combined = true;
+                            }
+                        }
+                    }
+                }
+                float area = 0;
+                for(auto &r : merged) area += r.width * r.height;
+                if(area > DAMAGE_FULL_REDRAW_RATIO * screen.width * screen.height) merged.assign(1, screen);
+            }
+            if(stats){
+                float area = 0;
+                for(auto &r : merged) area += r.width * r.height;
+                *stats = {m_reported, merged.size(), area / (screen.width * screen.height)};
+            }
+            return merged;
+        }
+
+        void Clear(){
+            m_rects.clear();
+            m_full = false;
+            m_reported = 0;
+        }
+    };
+
+    DamageTracker damageTracker;
+
+    void InvalidateRect(Rectangle rect){
+        //Reports that rect on screen has to be redrawn
+        damageTracker.Add(rect);
+    }
+
+    void InvalidateScreen(){
+        damageTracker.AddAll();
+    }
+
+#define SPATIAL_GRID_CELL_SIZE 128 // Side of a SpatialGrid cell in pixels
+
+    class GuiElement;
+
+    class SpatialGrid{
+        /* Buckets element bounds into square cells so the element under a point is found by testing only the elements
+         * sharing its cell. Bounds are in the elements' own coordinates, which a window's children have relative to
+         * its corner, so the grid stays valid while the window moves. Later insertions are on top of earlier ones.*/
+        struct Entry{
+            Rectangle bounds;
+            uint64_t order;
+        };
+
+        std::unordered_map<GuiElement*,Entry> m_entries;
+        std::unordered_map<uint64_t,std::vector<GuiElement*>> m_cells;
+        uint64_t m_nextOrder = 0;
+
+        static uint64_t CellKey(int x, int y){
+            return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+        }
+
+        static void CellRange(Rectangle bounds, int *x0, int *y0, int *x1, int *y1){
+            *x0 = (int)std::floor(bounds.x / SPATIAL_GRID_CELL_SIZE);
+            *y0 = (int)std::floor(bounds.y / SPATIAL_GRID_CELL_SIZE);
+            *x1 = (int)std::floor((bounds.x + bounds.width) / SPATIAL_GRID_CELL_SIZE);
+            *y1 = (int)std::floor((bounds.y + bounds.height) / SPATIAL_GRID_CELL_SIZE);
+        }
+
+        void Link(GuiElement *element, Rectangle bounds){
+            int x0, y0, x1, y1;
+            CellRange(bounds, &x0, &y0, &x1, &y1);
+            for(int y = y0; y <= y1; y++){
+                for(int x = x0; x <= x1; x++) m_cells[CellKey(x, y)].push_back(element);
+            }
+        }
+
+        void Unlink(GuiElement *element, Rectangle bounds){
+            int x0, y0, x1, y1;
+            CellRange(bounds, &x0, &y0, &x1, &y1);
+            for(int y = y0; y <= y1; y++){
+                for(int x = x0; x <= x1; x++){
+                    auto cell = m_cells.find(CellKey(x, y));
+                    if(cell == m_cells.end()) continue;
+                    auto &elements = cell->second;
+                    auto it = std::find(elements.begin(), elements.end(), element);
+                    if(it == elements.end()) continue; // Not in this cell
+                    elements.erase(it);
+                    if(elements.empty()) m_cells.erase(cell);
+                }
+            }
+        }
+
+    public:
+        void Insert(GuiElement *element, Rectangle bounds){
+            //On top of everything inserted before it
+            Remove(element);
+            m_entries[element] = {bounds, m_nextOrder++};
+            Link(element, bounds);
+        }
+
+        void Move(GuiElement *element, Rectangle bounds){
+            //Ignored for elements that were never inserted
+            auto entry = m_entries.find(element);
+            if(entry == m_entries.end()) return;
+            Rectangle &old = entry->second.bounds;
+            if(old.x == bounds.x && old.y == bounds.y && old.width == bounds.width && old.height == bounds.height) return;
+            int a[4], b[4];
+            CellRange(old, &a[0], &a[1], &a[2], &a[3]);
+            CellRange(bounds, &b[0], &b[1], &b[2], &b[3]);
+            if(!std::equal(a, a + 4, b)){
+                Unlink(element, old);
+                Link(element, bounds);
+            }
+            old = bounds;
+        }
+
+        void Remove(GuiElement *element){
+            auto entry = m_entries.find(element);
+            if(entry == m_entries.end()) return;
+            Unlink(element, entry->second.bounds);
+            m_entries.erase(entry);
+        }
+
+        void Clear(){
+            m_entries.clear();
+            m_cells.clear();
+        }
+
+        [[nodiscard]] GuiElement *TopmostAt(Vector2 point) const {
+            //The last inserted element whose bounds contain point, nullptr if there is none
+            auto cell = m_cells.find(CellKey((int)std::floor(point.x / SPATIAL_GRID_CELL_SIZE), (int)std::floor(point.y / SPATIAL_GRID_CELL_SIZE)));
+            if(cell == m_cells.end()) return nullptr;
+            GuiElement *top = nullptr;
+            uint64_t topOrder = 0;
+            for(auto element : cell->second){
+                const Entry &entry = m_entries.at(element);
+                if((top == nullptr || entry.order > topOrder) && CheckCollisionPointRec(point, entry.bounds)){
+                    top = element;
+                    topOrder = entry.order;
+                }
+            }
+            return top;
+        }
+
+        [[nodiscard]] uint64_t Order(GuiElement *element) const {
+            auto entry = m_entries.find(element);
+            return entry == m_entries.end() ? 0 : entry->second.order;
+        }
+
+        [[nodiscard]] bool Contains(GuiElement *element) const {
+            return m_entries.count(element) != 0;
+        }
+
+        [[nodiscard]] size_t Size() const {
+            return m_entries.size();
+        }
+    };
+
+    class FocusManager{
+        /* The single element keyboard input goes to. Elements take and give up focus with GuiElement::Focus and Blur,
+         * RTKRuntime moves it with Tab and Shift+Tab and hands the focused element the keys typed each frame.*/
+        GuiElement *m_focused = nullptr;
+    public:
+        [[nodiscard]] GuiElement *GetFocused() const {
+            return m_focused;
+        }
+
+        GuiElement *Exchange(GuiElement *element){
+            //Sets the focused element without notifying either one, returns the previous one
+            GuiElement *previous = m_focused;
+            m_focused = element;
+            return previous;
+        }
+
+        void Forget(GuiElement *element){
+            //For elements being destroyed
+            if(m_focused == element) m_focused = nullptr;
+        }
+    };
+
+    FocusManager focusManager;
+
+#define HANDLE_NO_SLOT UINT32_MAX // Marks a free slot, and ends the free list
+
+    struct ElementHandle{
+        //Names an element without owning it. Generation 0 is never issued, so a default handle is null
+        uint32_t index = 0;
+        uint32_t generation = 0;
+
+        [[nodiscard]] bool IsNull() const {
+            return generation == 0;
+        }
+
+        bool operator==(const ElementHandle &other) const {return index == other.index && generation == other.generation;}
+        bool operator!=(const ElementHandle &other) const {return !(*this == other);}
+    };
+
+    class HandleTable{
+        /* The slot table behind ElementHandle. A handle's index picks a slot, the slot points into a dense array of
+         * the live elements, and the handle only resolves while its generation matches the slot's. Removing an
+         * element moves the last dense entry into its place and bumps the slot's generation, so handles still held to
+         * it resolve to nullptr from then on instead of dangling. Freed slots are reused, newest first */
+        struct Slot{
+            uint32_t generation = 1;
+            uint32_t dense = HANDLE_NO_SLOT; // Position in m_elements, HANDLE_NO_SLOT while free
+            uint32_t nextFree = HANDLE_NO_SLOT;
+        };
+        std::vector<Slot> m_slots;
+        std::vector<GuiElement*> m_elements; // Live elements, in no particular order
+        std::vector<uint32_t> m_owners; // The slot of each entry in m_elements
+        uint32_t m_freeSlot = HANDLE_NO_SLOT;
+
+    public:
+        ElementHandle Insert(GuiElement *element){
+            uint32_t index;
+            if(m_freeSlot != HANDLE_NO_SLOT){
+                index = m_freeSlot;
+                m_freeSlot = m_slots[index].nextFree;
+            }
+            else{
+                index = (uint32_t)m_slots.size();
+                m_slots.emplace_back();
+            }
+            Slot &slot = m_slots[index];
+            slot.dense = (uint32_t)m_elements.size();
+            slot.nextFree = HANDLE_NO_SLOT;
+            m_elements.push_back(element);
+            m_owners.push_back(index);
+            return {index, slot.generation};
+        }
+
+        [[nodiscard]] GuiElement *Get(ElementHandle handle) const {
+            //nullptr for null handles and handles to removed elements
+            if(handle.index >= m_slots.size()) return nullptr;
+            const Slot &slot = m_slots[handle.index];
+            if(slot.generation != handle.generation || slot.dense == HANDLE_NO_SLOT) return nullptr;
+            return m_elements[slot.dense];
+        }
+
+        bool Remove(ElementHandle handle){
+            if(Get(handle) == nullptr) return false;
+            Slot &slot = m_slots[handle.index];
+            uint32_t last = (uint32_t)m_elements.size() - 1;
+            if(slot.dense != last){
+                m_elements[slot.dense] = m_elements[last];
+                m_owners[slot.dense] = m_owners[last];
+                m_slots[m_owners[slot.dense]].dense = slot.dense;
+            }
+            m_elements.pop_back();
+            m_owners.pop_back();
+            slot.dense = HANDLE_NO_SLOT;
+            if(++slot.generation == 0) slot.generation = 1;
+            slot.nextFree = m_freeSlot;
+            m_freeSlot = handle.index;
+            return true;
+        }
+
+        [[nodiscard]] bool IsValid(ElementHandle handle) const {
+            return Get(handle) != nullptr;
+        }
+
+        [[nodiscard]] size_t Size() const {
+            return m_elements.size();
+        }
+
+        [[nodiscard]] const std::vector<GuiElement*> &GetElements() const {
+            return m_elements;
+        }
+    };
+
+    HandleTable elementHandles;
+
+    class ActiveSet{
+        //Children of a container that are updated every frame whether or not the mouse is over them. Adding and
+        //removing are O(1), the order of the elements is not kept
+        std::vector<GuiElement*> m_elements;
+        std::unordered_map<GuiElement*,size_t> m_positions; // Of each element in m_elements
+    public:
+        void Add(GuiElement *element){
+            if(m_positions.emplace(element, m_elements.size()).second) m_elements.push_back(element);
+        }
+
+        void Remove(GuiElement *element){
+            auto it = m_positions.find(element);
+            if(it == m_positions.end()) return;
+            size_t position = it->second;
+            m_positions.erase(it);
+            if(position != m_elements.size() - 1){
+                m_elements[position] = m_elements.back();
+                m_positions[m_elements[position]] = position;
+            }
+            m_elements.pop_back();
+        }
+
+        [[nodiscard]] bool Contains(GuiElement *element) const {
+            return m_positions.count(element) != 0;
+        }
+
+        void Clear(){
+            m_elements.clear();
+            m_positions.clear();
+        }
+
+        [[nodiscard]] const std::vector<GuiElement*> &GetElements() const {
+            return m_elements;
+        }
+
+        [[nodiscard]] size_t Size() const {
+            return m_elements.size();
+        }
+    };
+
+    struct SchedulerStats{
+        size_t elements; // Children of every container visited this frame
+        size_t active; // Of those, the ones in an active set
+        size_t updated; // Update calls, the active ones plus the ones under the mouse now or last frame
+    };
+
+    SchedulerStats schedulerStats = {0, 0, 0};
+
+#define ELEMENT_SLAB_SIZE 65536 // Bytes taken from the heap at a time by each element pool
+#define ELEMENT_ALLOC_ALIGN 16 // Pooled sizes are rounded up to this, and every block starts on it
+#define ELEMENT_MAX_POOLED 2048 // Larger objects skip the pools and go straight to the heap
+#define ELEMENT_ARENA_BLOCK_SIZE 65536 // Minimum bytes an arena takes from the heap at a time
+#define ELEMENT_ALLOC_HEADER ELEMENT_ALLOC_ALIGN // Bytes in front of every element for its AllocationHeader
+
+    struct AllocationStats{
+        size_t allocations; // Element allocations of every kind
+        size_t frees; // Element deallocations of every kind
+        size_t live; // allocations - frees
+        size_t pooledBytes; // Bytes handed out by the pools and still in use
+        size_t slabs; // Heap requests made by the pools, each ELEMENT_SLAB_SIZE
+        size_t reused; // Allocations served from a pool's free list
+        size_t arenaAllocations; // Allocations served by an arena
+        size_t arenaBlocks; // Heap requests made by arenas, still held
+        size_t heapAllocations; // Objects too big for a pool, allocated on their own
+    };
+
+    class ElementArena{
+        /* Bump allocator for a whole layout. Objects allocated while it is current (see ElementArenaScope) are laid out
+         * one after another in construction order, so siblings sit next to each other. Deleting one of them runs its
+         * destructor but keeps its memory, Release() returns all of it at once once every object in it is destroyed.
+         * While any is alive Release keeps the blocks, and an arena destroyed then leaves them and its live count
+         * behind, so those objects stay valid and can still be deleted */
+        struct Block{
+            char *data;
+            size_t size;
+        };
+        std::vector<Block> m_blocks;
+        size_t m_used = 0; // In m_blocks.back()
+        size_t m_allocations = 0;
+        size_t *m_live = new size_t(0); // Allocations not yet freed, Release needs it to be 0. Their headers point to it
+    public:
+        ElementArena() = default;
+        ~ElementArena();
+        ElementArena(const ElementArena &other) = delete;
+        ElementArena &operator=(const ElementArena &other) = delete;
+
+        void *Allocate(size_t size);
+        bool Release();
+
+        [[nodiscard]] size_t *GetLiveCounter() const {
+            return m_live;
+        }
+
+        [[nodiscard]] size_t GetAllocationCount() const {
+            return m_allocations;
+        }
+
+        [[nodiscard]] size_t GetLiveCount() const {
+            return *m_live;
+        }
+
+        [[nodiscard]] size_t GetBlockCount() const {
+            return m_blocks.size();
+        }
+    };
+
+    struct AllocationHeader{
+        //In front of every element the allocator hands out, so freeing it needs no search for where it came from
+        size_t *arenaLive; // Live count of the arena holding the element, nullptr for pooled and heap memory
+    };
+
+    static_assert(sizeof(AllocationHeader) <= ELEMENT_ALLOC_HEADER, "AllocationHeader does not fit ELEMENT_ALLOC_HEADER");
+
+    class ElementAllocator{
+        /* Backs operator new and delete of every GuiElement. Each size class has its own pool of ELEMENT_SLAB_SIZE slabs,
+         * so elements of one type created together are contiguous, and a freed block is kept on the pool's free list
+         * for the next element of that size. The slabs are never given back, the pools only grow to the peak in use.
+         * Every block starts with an AllocationHeader, the element follows it */
+        struct FreeBlock{
+            FreeBlock *next;
+        };
+        struct Pool{
+            FreeBlock *free = nullptr;
+            char *cursor = nullptr; // Unused part of the newest slab
+            char *end = nullptr;
+        };
+        Pool m_pools[ELEMENT_MAX_POOLED / ELEMENT_ALLOC_ALIGN];
+        ElementArena *m_currentArena = nullptr;
+        AllocationStats m_stats = {0, 0, 0, 0, 0, 0, 0, 0, 0};
 
-    return defaultTheme;
-}
+        static size_t Rounded(size_t size){
+            return (size + ELEMENT_ALLOC_ALIGN - 1) / ELEMENT_ALLOC_ALIGN * ELEMENT_ALLOC_ALIGN;
+        }
 
-TextSettings LoadDefaultTextSettings(){
-    TextSettings settings = {
-            .horizontalAlign = TextAlign::Start,
-            .verticalAlign = TextAlign::Center,
-            .fontSize = 16,
-            .fontMargin = {0.25f,0.25f},
-            .spacing = GET_SPACING(settings.fontSize)
-    };
-    return settings;
+        static AllocationHeader *HeaderOf(void *ptr){
+            return reinterpret_cast<AllocationHeader*>(static_cast<char*>(ptr) - ELEMENT_ALLOC_HEADER);
+        }
 
-}
-    void FindMaxFontSize(const char *text, TextSettings *textSettings, Rectangle rectangle, Theme theme, float minimumFontSize = 0) {
-        textSettings->fontSize = rectangle.height;
+        void *AllocateBlock(size_t size){
+            if(m_currentArena){
+                m_stats.arenaAllocations++;
+                return m_currentArena->Allocate(size);
+            }
+            if(size > ELEMENT_MAX_POOLED){
+                m_stats.heapAllocations++;
+                return ::operator new(size);
+            }
+            size = Rounded(size);
+            m_stats.pooledBytes += size;
+            Pool &pool = m_pools[size / ELEMENT_ALLOC_ALIGN - 1];
+            if(pool.free){
+                FreeBlock *block = pool.free;
+                pool.free = block->next;
+                m_stats.reused++;
+                return block;
+            }
+            if(pool.cursor == nullptr || pool.end - pool.cursor < (ptrdiff_t)size){
+                pool.cursor = static_cast<char*>(::operator new(ELEMENT_SLAB_SIZE));
+                pool.end = pool.cursor + ELEMENT_SLAB_SIZE;
+                m_stats.slabs++;
+            }
+            void *ptr = pool.cursor;
+            pool.cursor += size;
+            return ptr;
+        }
 
-        Vector2 measuredSize = MeasureTextEx(theme.font, text, textSettings->fontSize, textSettings->spacing);
-        while (measuredSize.x > rectangle.width * (1 - 2 * textSettings->fontMargin.x) ||
-               measuredSize.y > rectangle.height * (1 - 2 * textSettings->fontMargin.y)) {
-            textSettings->fontSize -= 2;
-            textSettings->spacing = GET_SPACING(textSettings->fontSize);
-            measuredSize = MeasureTextEx(theme.font, text, textSettings->fontSize, textSettings->spacing);
+    public:
+        void *Allocate(size_t size){
+            if(size == 0) size = 1;
+            m_stats.allocations++;
+            m_stats.live++;
+            char *block = static_cast<char*>(AllocateBlock(size + ELEMENT_ALLOC_HEADER));
+            reinterpret_cast<AllocationHeader*>(block)->arenaLive = m_currentArena ? m_currentArena->GetLiveCounter() : nullptr;
+            return block + ELEMENT_ALLOC_HEADER;
+        }
+
+        void Free(void *ptr, size_t size){
+            //ptr must come from Allocate
+            if(ptr == nullptr) return;
+            if(size == 0) size = 1;
+            m_stats.frees++;
+            m_stats.live--;
+            AllocationHeader *header = HeaderOf(ptr);
+            if(header->arenaLive){
+                (*header->arenaLive)--; // Given back with the rest of the arena
+                return;
+            }
+            ptr = header;
+            size += ELEMENT_ALLOC_HEADER;
+            if(size > ELEMENT_MAX_POOLED){
+                ::operator delete(ptr);
+                return;
+            }
+            size = Rounded(size);
+            m_stats.pooledBytes -= size;
+            Pool &pool = m_pools[size / ELEMENT_ALLOC_ALIGN - 1];
+            auto block = static_cast<FreeBlock*>(ptr);
+            block->next = pool.free;
+            pool.free = block;
         }
-        if(textSettings->fontSize < minimumFontSize) {
-            textSettings->fontSize = minimumFontSize;
-            textSettings->spacing = GET_SPACING(textSettings->fontSize);
+
+        ElementArena *SetArena(ElementArena *arena){
+            //Allocations go to arena until it is set back, nullptr for the pools. Returns the previous one
+            ElementArena *previous = m_currentArena;
+            m_currentArena = arena;
+            return previous;
         }
-    }
 
-    void DrawTextInRectangle(const char *text, Rectangle rectangle, Theme theme, TextSettings textSettings, GuiElementState state = Normal, bool drawOutline = false){
-        Vector2 offset = {rectangle.x, rectangle.y};
-        Vector2 textSize = MeasureTextEx(theme.font, text, textSettings.fontSize, textSettings.spacing);
+        void ArenaDestroyed(ElementArena *arena){
+            if(m_currentArena == arena) m_currentArena = nullptr;
+        }
 
-        switch(textSettings.horizontalAlign){
-            case TextAlign::Start:
-                offset.x += rectangle.width * textSettings.fontMargin.x;
-                break;
-            case TextAlign::Center:
-                offset.x +=  rectangle.width / 2 - textSize.x / 2;
-                break;
-            case TextAlign::End:
-                offset.x += rectangle.width - textSize.x - textSettings.fontMargin.x * rectangle.width;
-                break;
+        void ArenaBlocksChanged(long change){
+            m_stats.arenaBlocks += change;
         }
-        switch(textSettings.verticalAlign){
-            case TextAlign::Start:
-                offset.y += rectangle.height * textSettings.fontMargin.y;
-                break;
-            case TextAlign::Center:
-                offset.y += rectangle.height / 2 - textSize.y / 2;
-                break;
-            case TextAlign::End:
-                offset.y += rectangle.height - textSize.y - textSettings.fontMargin.y * rectangle.height;
-                break;
+
+        [[nodiscard]] const AllocationStats &GetStats() const {
+            return m_stats;
         }
-        DrawTextEx(theme.font, text, offset, textSettings.fontSize, textSettings.spacing, theme.text[state]);
-        if(drawOutline) DrawRectangleLines(offset.x,offset.y,textSize.x,textSize.y,GREEN);
+    };
 
+    ElementAllocator &GetElementAllocator(){
+        //Never destroyed, elements deleted by other static destructors still find it
+        static auto *allocator = new ElementAllocator();
+        return *allocator;
     }
 
-    int FindLargestCharacterSize(Font font, bool (*filterFunction)(int) = IsAscii){
-        int maxSize = 0;
-        for(unsigned char key = 0; key < 255; key++){
-            if(filterFunction(key)){
-                int index;
-                int codepoint = GetCodepoint((char*)&key,&index); //don't care about codepointSize but can't do null due to segfault
-                index = GetGlyphIndex(font,codepoint);
-                if(key != '\n'){
-                    int width;
-                    if(font.glyphs[index].advanceX!=0){
-                        width = font.glyphs[index].advanceX;
-                    }
-                    else{
-                        width = font.recs[index].width + font.glyphs[index].offsetX;
-                    }
-                    maxSize = std::max(maxSize,width);
-                }
-            }
-        }
-        return maxSize;
+    AllocationStats GetAllocationStats(){
+        return GetElementAllocator().GetStats();
     }
 
-    unsigned char FindLargestCharacter(Font font, bool (*filterFunction)(int) = IsAscii){
-        int maxSize = 0;
-        unsigned char biggest = 0;
-        for(unsigned char key = 0; key < 255; key++){
-            if(filterFunction(key)){
-                int index;
-                int codepoint = GetCodepoint((char*)&key,&index); //don't care about codepointSize but can't do null due to segfault
-                index = GetGlyphIndex(font,codepoint);
-                if(key != '\n'){
-                    int width;
-                    if(font.glyphs[index].advanceX!=0){
-                        width = font.glyphs[index].advanceX;
-                    }
-                    else{
-                        width = font.recs[index].width + font.glyphs[index].offsetX;
-                    }
-                    if(width > maxSize){
-                        maxSize = width;
-                        biggest = key;
-                    }
-                }
-            }
+    ElementArena::~ElementArena(){
+        GetElementAllocator().ArenaDestroyed(this);
+        if(Release()){
+            delete m_live;
         }
-        return biggest;
+        //Otherwise the blocks and m_live are left for the objects still alive in them
     }
 
-GuiElementState MouseDetection(Rectangle rect){
+    void *ElementArena::Allocate(size_t size){
+        size = (size + ELEMENT_ALLOC_ALIGN - 1) / ELEMENT_ALLOC_ALIGN * ELEMENT_ALLOC_ALIGN;
+        if(m_blocks.empty() || m_blocks.back().size - m_used < size){
+            size_t blockSize = std::max((size_t)ELEMENT_ARENA_BLOCK_SIZE, size);
+            m_blocks.push_back({static_cast<char*>(::operator new(blockSize)), blockSize});
+            m_used = 0;
+            GetElementAllocator().ArenaBlocksChanged(1);
+        }
+        void *ptr = m_blocks.back().data + m_used;
+        m_used += size;
+        m_allocations++;
+        (*m_live)++;
+        return ptr;
+    }
+
+    bool ElementArena::Release(){
+        //Frees the blocks if everything allocated from the arena is destroyed, returns whether it did
+        if(*m_live != 0) return false;
+        for(Block &b : m_blocks){
+            ::operator delete(b.data);
+        }
+        GetElementAllocator().ArenaBlocksChanged(-(long)m_blocks.size());
+        m_blocks.clear();
+        m_used = 0;
+        m_allocations = 0;
+        return true;
+    }
+
+    class ElementArenaScope{
+        //Elements created while this is alive are allocated from arena
+        ElementArena *m_previous;
+    public:
+        explicit ElementArenaScope(ElementArena &arena){
+            m_previous = GetElementAllocator().SetArena(&arena);
+        }
+
+        ~ElementArenaScope(){
+            GetElementAllocator().SetArena(m_previous);
+        }
+
+        ElementArenaScope(const ElementArenaScope &other) = delete;
+        ElementArenaScope &operator=(const ElementArenaScope &other) = delete;
+    };
+
+GuiElementState MouseDetection(const InputState &input, Rectangle rect){
     GuiElementState state = Normal;
-    if(CheckCollisionPointRec(GetMousePosition(),rect)){
-        if(IsMouseButtonDown(MOUSE_LEFT_BUTTON)){
+    if(input.MouseOver(rect)){
+        if(input.IsMouseButtonDown(MOUSE_LEFT_BUTTON)){
             state = Pressed;
         }
         else{
@@ -290,18 +2823,42 @@ GuiElementState MouseDetection(Rectangle rect){
     private:
     protected:
         Rectangle m_rect; // The display rectangle. Where it appears on screen and size
-        Theme m_theme = LoadDefaultTheme(); // The theme that affects how the element looks
+        ThemeId m_themeId = themeTable.Retain(DefaultThemeId()); // The theme that affects how the element looks, one of its users
+        std::unique_ptr<Theme> m_themeOverride; // Used instead of m_themeId when this element is styled on its own
         GuiElementState m_state = Normal; // enable, focus (mouse hover), pressed, disabled
+        GuiElement *m_parent = nullptr; // The container drawing this element, told when its appearance changes
+        ActiveSet *m_activeSet = nullptr; // Of the scheduler updating this element, nullptr when nothing does
+        ElementHandle m_handle; // Issued by GetHandle, null until then
+
+        void AdoptThemeId(ThemeId id){
+            //id already counts this element as a user
+            themeTable.Release(m_themeId);
+            m_themeId = id;
+        }
 
     public:
-        GuiElement(Rectangle rect = {0,0,800,450}, Theme theme = LoadDefaultTheme(), GuiElementState state = Normal){
-            m_theme = theme;
+        GuiElement(Rectangle rect = {0,0,800,450}, ThemeId theme = DefaultThemeId(), GuiElementState state = Normal){
+            AdoptThemeId(themeTable.Retain(theme));
             m_state = state;
             m_rect = rect;
         }
 
+        //The parent is not copied, a copy belongs to whichever container adds it
+        GuiElement(const GuiElement &other) : m_rect(other.m_rect), m_themeId(themeTable.Retain(other.m_themeId)), m_state(other.m_state){
+            if(other.m_themeOverride) m_themeOverride = std::make_unique<Theme>(*other.m_themeOverride);
+        }
+
+        GuiElement &operator=(const GuiElement &other){
+            m_rect = other.m_rect;
+            AdoptThemeId(themeTable.Retain(other.m_themeId));
+            m_themeOverride = other.m_themeOverride ? std::make_unique<Theme>(*other.m_themeOverride) : nullptr;
+            m_state = other.m_state;
+            MarkDirty();
+            return *this;
+        }
+
         void GuiElementFromJson(const json &j){
-            m_theme = ThemeFromJson(j["theme"]);
+            AdoptThemeId(themeTable.Acquire(ThemeFromJson(j["theme"])));
             m_rect = RectangleFromJson(j);
             if(j.contains("state")){
                 m_state = j["state"];
@@ -315,10 +2872,197 @@ GuiElementState MouseDetection(Rectangle rect){
             GuiElementFromJson(j);
         }
 
-        virtual ~GuiElement(){};
+        virtual ~GuiElement(){
+            focusManager.Forget(this);
+            if(m_activeSet) m_activeSet->Remove(this);
+            if(!m_handle.IsNull()) elementHandles.Remove(m_handle);
+            themeTable.Release(m_themeId);
+        };
+
+        ElementHandle GetHandle(){
+            //A handle that resolves to this element until it is destroyed, for anything that outlives it or can't own it
+            if(m_handle.IsNull()) m_handle = elementHandles.Insert(this);
+            return m_handle;
+        }
+
+        //Elements come from the element pools, or the current arena (see ElementAllocator)
+        static void *operator new(size_t size){
+            return GetElementAllocator().Allocate(size);
+        }
+
+        static void operator delete(void *ptr, size_t size){
+            GetElementAllocator().Free(ptr, size);
+        }
 
         virtual void Draw(){}
-        virtual void Update(){}
+        virtual void Update(InputState &input){}
+
+        virtual bool DrawResolved(Color base, Color line, float lineWidth){
+            //Draws with the theme colours for the element's state already looked up, for containers that resolve them
+            //in bulk. Elements drawn with more than these return false without drawing, and get Draw instead
+            return false;
+        }
+
+        [[nodiscard]] virtual Rectangle GetBounds() {
+            //Everything the element draws lies inside this, usually its rectangle
+            return m_rect;
+        }
+
+        [[nodiscard]] virtual Vector2 ChildOrigin() {
+            //Where the coordinates of the element's children start, in the element's own. Containers that move their
+            //children with them put it at their top left corner
+            return {0, 0};
+        }
+
+        [[nodiscard]] Vector2 ScreenOrigin() {
+            //Where the element's own coordinates start on screen, the sum of the child origins above it
+            if(!m_parent) return {0, 0};
+            Vector2 parent = m_parent->ScreenOrigin();
+            Vector2 offset = m_parent->ChildOrigin();
+            return {parent.x + offset.x, parent.y + offset.y};
+        }
+
+        [[nodiscard]] Rectangle ToScreen(Rectangle rect) {
+            //rect from the element's coordinates to the screen's
+            return OffsetRect(rect, ScreenOrigin());
+        }
+
+        [[nodiscard]] Rectangle GetScreenBounds() {
+            return ToScreen(GetBounds());
+        }
+
+        virtual void MarkDirty(){
+            //Called whenever the element would draw differently. Its area on screen is damaged and a container caching
+            //its drawing redraws it
+            InvalidateRect(GetScreenBounds());
+            if(m_parent) m_parent->ChildChanged(this);
+        }
+
+        virtual void ChildChanged(GuiElement *child){
+            //child is a direct child, which changed or moved
+            if(m_parent) m_parent->ChildChanged(this);
+        }
+
+        void MarkMoved(Rectangle previousBounds){
+            //The element moved without changing otherwise, only the area it left and the area it covers now are damaged
+            InvalidateRect(ToScreen(previousBounds));
+            InvalidateRect(GetScreenBounds());
+            if(m_parent) m_parent->ChildChanged(this);
+        }
+
+        void UpdateTracked(InputState &input){
+            /* Update, then mark the element dirty if the update changed its state or rectangle. An element that blocks
+             * input consumes the mouse when it is over it, so elements below it don't react to it.*/
+            GuiElementState state = m_state;
+            Rectangle rect = m_rect;
+            Rectangle bounds = GetBounds();
+            Update(input);
+            if(m_state != state || m_rect.width != rect.width || m_rect.height != rect.height){
+                InvalidateRect(ToScreen(bounds));
+                MarkDirty();
+            }
+            else if(m_rect.x != rect.x || m_rect.y != rect.y){
+                MarkMoved(bounds);
+            }
+            if(BlocksInput() && input.MouseOver(GetBounds())) input.ConsumeMouse();
+        }
+
+        [[nodiscard]] virtual bool BlocksInput() {
+            //Whether the element hides what is below it from the mouse
+            return m_state != Disabled;
+        }
+
+        [[nodiscard]] virtual bool HoldsInput() {
+            //Whether the element needs updating while the mouse is not over it
+            return HasPendingWork();
+        }
+
+        [[nodiscard]] virtual bool IsFocusable() {
+            //Whether Tab stops at the element
+            return false;
+        }
+
+        [[nodiscard]] bool HasFocus() const {
+            return focusManager.GetFocused() == this;
+        }
+
+        void Focus(){
+            //Takes keyboard focus from whichever element has it
+            if(HasFocus()) return;
+            GuiElement *previous = focusManager.Exchange(this);
+            if(previous){
+                previous->FocusLost();
+                previous->Activate();
+            }
+            FocusGained();
+            Activate();
+        }
+
+        void Blur(){
+            if(!HasFocus()) return;
+            focusManager.Exchange(nullptr);
+            FocusLost();
+            Activate();
+        }
+
+        void BlurWithin(){
+            //Blurs the element or whichever of its descendants has focus, for containers removing it
+            GuiElement *focused = focusManager.GetFocused();
+            for(GuiElement *e = focused; e; e = e->m_parent){
+                if(e == this){
+                    focused->Blur();
+                    return;
+                }
+            }
+        }
+
+        virtual void FocusGained(){}
+        virtual void FocusLost(){}
+
+        virtual void KeyInput(InputState &input){
+            //Receives the frame's keys while the element has focus, no other element sees them
+        }
+
+        virtual void CollectFocusable(std::vector<GuiElement*> &elements){
+            //Appends the focusable elements in this subtree in Tab order
+            if(IsFocusable()) elements.push_back(this);
+        }
+
+        [[nodiscard]] virtual bool HasPendingWork() {
+            //True while the element needs frames to run without new input, such as a held key repeating. Work that
+            //starts outside of Update has to call Activate
+            return false;
+        }
+
+        void Activate(){
+            //Has the element updated next frame, and every frame after while it HoldsInput
+            if(m_activeSet) m_activeSet->Add(this);
+            if(m_parent) m_parent->Activate();
+        }
+
+        void SetActiveSet(ActiveSet *activeSet){
+            if(m_activeSet && m_activeSet != activeSet) m_activeSet->Remove(this);
+            m_activeSet = activeSet;
+        }
+
+        bool DrawClipped(){
+            //Draws the element unless it lies entirely outside the current clip rectangle, true if it was drawn
+            if(!CheckCollisionRecs(GetBounds(), CurrentClipRect())){
+                cullStats.culled++;
+                return false;
+            }
+            cullStats.drawn++;
+            Draw();
+            return true;
+        }
+
+        void SetParent(GuiElement *parent){
+            m_parent = parent;
+        }
+
+        [[nodiscard]] GuiElement *GetParent() const {
+            return m_parent;
+        }
 
 
         [[nodiscard]] const Rectangle &GetRect() {
@@ -334,15 +3078,43 @@ GuiElementState MouseDetection(Rectangle rect){
         }
 
         void SetRect(const Rectangle &mRect) {
+            InvalidateRect(GetScreenBounds());
             m_rect = mRect;
+            MarkDirty();
         }
 
         [[nodiscard]] const Theme &GetTheme() const {
-            return m_theme;
+            return m_themeOverride ? *m_themeOverride : themeTable.Get(m_themeId);
         }
 
         void SetTheme(const Theme &mTheme) {
-            m_theme = mTheme;
+            //Shares the table entry of an identical theme, or adds one that goes away with its last user
+            AdoptThemeId(themeTable.Acquire(mTheme));
+            MarkDirty();
+        }
+
+        [[nodiscard]] ThemeId GetThemeId() const {
+            return m_themeId;
+        }
+
+        void SetThemeId(ThemeId id) {
+            AdoptThemeId(themeTable.Retain(id));
+            MarkDirty();
+        }
+
+        void SetThemeOverride(const Theme &theme) {
+            //A private copy for this element only, it no longer follows changes to its ThemeId
+            m_themeOverride = std::make_unique<Theme>(theme);
+            MarkDirty();
+        }
+
+        void ClearThemeOverride() {
+            m_themeOverride.reset();
+            MarkDirty();
+        }
+
+        [[nodiscard]] bool HasThemeOverride() const {
+            return m_themeOverride != nullptr;
         }
 
         [[nodiscard]] GuiElementState GetState() const {
@@ -350,24 +3122,28 @@ GuiElementState MouseDetection(Rectangle rect){
         }
 
         void Enable() {
-            if(m_state==Disabled) m_state = Normal;
+            if(m_state==Disabled) SetState(Normal);
         }
 
         void Disable() {
-            m_state = Disabled;
+            SetState(Disabled);
         }
 
         virtual void ShiftRect(Vector2 translation){
             m_rect = {m_rect.x + translation.x, m_rect.y + translation.y, m_rect.width, m_rect.height};
         }
 
-        void ScaleRect(Rectangle window){
-            m_rect = {window.x + m_rect.x / window.width, window.y + m_rect.y / window.height, m_rect.width / window.width, m_rect.height / window.height};
+        virtual void ScaleRect(Vector2 scale){
+            //Scales the element's size about its top left corner. Containers scale their children with them
+            InvalidateRect(GetScreenBounds());
+            m_rect.width *= scale.x;
+            m_rect.height *= scale.y;
+            MarkDirty();
         }
 
-        void MouseDetection(Rectangle rect){
-            if(CheckCollisionPointRec(GetMousePosition(),rect)){
-                if(IsMouseButtonDown(MOUSE_LEFT_BUTTON)){
+        void MouseDetection(InputState &input, Rectangle rect){
+            if(input.MouseOver(rect)){
+                if(input.IsMouseButtonDown(MOUSE_LEFT_BUTTON)){
                     m_state = Pressed;
                 }
                 else{
@@ -379,9 +3155,9 @@ GuiElementState MouseDetection(Rectangle rect){
             }
         }
 
-        void MouseDetection(){
-            if(CheckCollisionPointRec(GetMousePosition(),m_rect)){
-                if(IsMouseButtonDown(MOUSE_LEFT_BUTTON)){
+        void MouseDetection(InputState &input){
+            if(input.MouseOver(m_rect)){
+                if(input.IsMouseButtonDown(MOUSE_LEFT_BUTTON)){
                     m_state = Pressed;
                 }
                 else{
@@ -396,34 +3172,36 @@ GuiElementState MouseDetection(Rectangle rect){
 
         //set state functions
         void SetStateNormal(){
-            m_state = Normal;
+            SetState(Normal);
         }
 
         void SetStateFocused(){
-            m_state = Focused;
+            SetState(Focused);
         }
 
         void SetStatePressed(){
-            m_state = Pressed;
+            SetState(Pressed);
         }
 
         void SetStateDisabled(){
-            m_state = Disabled;
+            SetState(Disabled);
         }
 
         void SetState(GuiElementState state){
+            if(m_state == state) return;
             m_state = state;
+            MarkDirty();
         }
 
         void ToggleState(){
-            if(m_state == Disabled) m_state = Normal;
-            else m_state = Disabled;
+            if(m_state == Disabled) SetState(Normal);
+            else SetState(Disabled);
         }
 
         void GuiElementToJson(json &j){
             JsonFromRectangle(j,m_rect);
             j["state"] = m_state;
-            j["theme"] = m_theme;
+            j["theme"] = GetTheme();
         }
 
         virtual void ToJson(json &j){
@@ -440,9 +3218,116 @@ GuiElementState MouseDetection(Rectangle rect){
 
     };
 
+    GuiElement *ResolveHandle(ElementHandle handle){
+        //nullptr once the element is destroyed
+        return elementHandles.Get(handle);
+    }
+
+    template<typename T>
+    T *ResolveHandle(ElementHandle handle){
+        //nullptr once the element is destroyed, or when it is not a T
+        return dynamic_cast<T*>(elementHandles.Get(handle));
+    }
+
+    class UpdateScheduler{
+        /* Picks the children of a container that are updated each frame, so update cost follows interaction instead of
+         * the number of children: the topmost child under the mouse, the one that was under it last frame so it can
+         * leave its hover state, and the active set. A child enters the active set when it is added, when it calls
+         * Activate (focus changes do) and after any update that leaves it holding input, and leaves it after an
+         * update that does not. Children not picked would not have changed if they had been updated.*/
+        SpatialGrid m_grid;
+        ActiveSet m_active;
+        GuiElement *m_hovered = nullptr;
+        std::vector<GuiElement*> m_route;
+
+    public:
+        UpdateScheduler() = default;
+        UpdateScheduler(const UpdateScheduler&) = delete; // Children point at m_active
+
+        ~UpdateScheduler(){
+            //Deleted children take themselves out of m_active, so everything left in it is alive. Children kept past
+            //this without being removed are left pointing at it, like they are left pointing at their parent
+            std::vector<GuiElement*> active = m_active.GetElements();
+            for(auto element : active) element->SetActiveSet(nullptr);
+        }
+
+        void Add(GuiElement *element){
+            //New children are updated once before they are left alone, so they can settle their state
+            m_grid.Insert(element, element->GetBounds());
+            element->SetActiveSet(&m_active);
+            m_active.Add(element);
+        }
+
+        void Moved(GuiElement *element){
+            m_grid.Move(element, element->GetBounds());
+        }
+
+        void Remove(GuiElement *element){
+            m_grid.Remove(element);
+            if(m_hovered == element) m_hovered = nullptr;
+            m_active.Remove(element);
+            element->SetActiveSet(nullptr);
+        }
+
+        void Clear(){
+            m_grid.Clear();
+            m_hovered = nullptr;
+            m_active.Clear();
+        }
+
+        void Dispatch(InputState &input){
+            //UpdateTracked on the picked children, topmost first. input's mouse is in the children's coordinates
+            GuiElement *hit = input.mouseConsumed ? nullptr : m_grid.TopmostAt(input.mouse);
+            m_route = m_active.GetElements();
+            for(auto element : {hit, m_hovered}){
+                if(element && std::find(m_route.begin(), m_route.end(), element) == m_route.end()) m_route.push_back(element);
+            }
+            std::sort(m_route.begin(), m_route.end(), [this](GuiElement *a, GuiElement *b){
+                return m_grid.Order(a) > m_grid.Order(b);
+            });
+
+            schedulerStats.elements += m_grid.Size();
+            schedulerStats.active += m_active.Size();
+            schedulerStats.updated += m_route.size();
+            for(auto element : m_route){
+                element->UpdateTracked(input);
+                Moved(element);
+                //Activate called by other elements later this frame still adds it back for the next one
+                if(element->HoldsInput()) m_active.Add(element);
+                else m_active.Remove(element);
+            }
+            m_hovered = hit;
+        }
+
+        [[nodiscard]] bool HoldingInput() const {
+            return m_active.Size() != 0;
+        }
+
+        [[nodiscard]] GuiElement *GetHovered() const {
+            return m_hovered;
+        }
+
+        [[nodiscard]] size_t ActiveCount() const {
+            return m_active.Size();
+        }
+    };
+
     class TextGuiElement : public GuiElement{
     protected:
         TextSettings m_textSettings = LoadDefaultTextSettings();
+
+        struct WrapParameters{
+            unsigned int fontId;
+            float fontSize;
+            float spacing;
+            float maximumRowWidth;
+
+            bool operator==(const WrapParameters &other) const {
+                return fontId == other.fontId && fontSize == other.fontSize && spacing == other.spacing && maximumRowWidth == other.maximumRowWidth;
+            }
+        };
+        std::vector<size_t> m_lineStarts; // Byte offset of every line produced by the last TextWrap
+        WrapParameters m_wrapParameters{};
     public:
         std::string m_text;
 
@@ -465,126 +3350,108 @@ GuiElementState MouseDetection(Rectangle rect){
         void SetAlign(TextAlign textAlign){
             m_textSettings.verticalAlign = textAlign;
             m_textSettings.horizontalAlign = textAlign;
+            MarkDirty();
         }
 
         void SetHorizontalAlign(TextAlign textAlign){
             m_textSettings.horizontalAlign = textAlign;
+            MarkDirty();
         }
 
-        void SetVerticalAlign(TextAlign textAlign) {m_textSettings.verticalAlign = textAlign;}
+        void SetVerticalAlign(TextAlign textAlign) {m_textSettings.verticalAlign = textAlign; MarkDirty();}
 
-        void SetFontSize(float size) {m_textSettings.fontSize = size;}
+        void SetFontSize(float size) {m_textSettings.fontSize = size; MarkDirty();}
 
         [[nodiscard]] float GetFontSize() const {return m_textSettings.fontSize;}
 
         [[nodiscard]] const TextSettings &GetTextSettings() const {return m_textSettings;}
 
-        void SetTextSettings(const TextSettings &mTextSettings) {m_textSettings = mTextSettings;}
+        void SetTextSettings(const TextSettings &mTextSettings) {m_textSettings = mTextSettings; MarkDirty();}
 
-        void SetFontMargin(Vector2 margin) {m_textSettings.fontMargin = margin;}
+        void SetFontMargin(Vector2 margin) {m_textSettings.fontMargin = margin; MarkDirty();}
 
         [[nodiscard]] Vector2 GetFontMargin() const {return m_textSettings.fontMargin;}
 
         void TextWrap(float marginForError = 0.95f){
             //Any newlines put manually into the text are overwritten.
             //inserts newline characters at optimal locations in the text string to make it wrap.
-            if(m_text.empty()) return;
-            struct Word{ //Implementing a stupid list because std::list encapsulates too much for me to understand
-                std::string s;
-                float width = 0;
-                Word *next = nullptr;
-            };
-            struct WordList{
-                Word *head;
-                Word *tail;
-
-                void append(Word *newWord){
-                    if(tail){
-                        tail->next = newWord;
-                        tail = newWord; //Assumes newWord has a nullptr next
-                    }
-                    else{
-                        head = newWord;
-                        tail = newWord;
+            TextWrapFrom(0, marginForError);
+        }
+
+        void TextWrapFrom(size_t editPosition, float marginForError = 0.95f){
+            /* Greedy wrap in one pass over the glyph advances. A word is measured with its trailing space, exactly as
+             * MeasureTextEx would measure it, and the space before a word that does not fit becomes the newline.
+             * If the font, size and row width are the same as the last wrap, lines ending before the line preceding
+             * editPosition are kept and only the rest of the text is rewrapped. The line before the edit has to be
+             * redone because a shortened word may now fit on it.*/
+            if(m_text.empty()){
+                m_lineStarts.clear();
+                return;
+            }
+            float maximumRowWidth = marginForError * m_rect.width * (1 - 2 * m_textSettings.fontMargin.x);
+            WrapParameters parameters = {GetTheme().font.texture.id, m_textSettings.fontSize, m_textSettings.spacing, maximumRowWidth};
+
+            size_t start = 0;
+            if(!m_lineStarts.empty() && parameters == m_wrapParameters){
+                size_t line = std::upper_bound(m_lineStarts.begin(), m_lineStarts.end(), editPosition) - m_lineStarts.begin();
+                line = line >= 2 ? line - 2 : 0;
+                start = std::min(m_lineStarts[line], m_text.size());
+                m_lineStarts.resize(line);
+            }
+            else{
+                m_lineStarts.clear();
+            }
+            m_wrapParameters = parameters;
+            m_lineStarts.push_back(start);
+
+            Font font = GetTheme().font;
+            if(font.glyphs == nullptr) return;
+            float scale = m_textSettings.fontSize / (float)font.baseSize;
+            int spaceAdvance = GetGlyphAdvance(font, ' ');
+
+            float rowWidth = 0;
+            bool rowHasWord = false;
+            size_t wordStart = start;
+            int wordAdvance = 0;
+            int wordGlyphs = 0;
+            for(size_t i = start; i <= m_text.size();){
+                if(i == m_text.size() || m_text[i] == ' ' || m_text[i] == '\n'){
+                    if(i < m_text.size()){
+                        m_text[i] = ' ';
+                        wordAdvance += spaceAdvance;
+                        wordGlyphs++;
                     }
-                }
-
-                void remove(Word *targetToRemove){
-                    Word *prev = nullptr;
-                    for(Word *it = head; it!= nullptr; it=it->next){
-                        if(it==targetToRemove){
-                            if(it==head){
-                                head = head->next;
-                            }
-                            if(it==tail){
-                                tail = prev;
-                                if(tail) tail->next = nullptr;
-                            }
-                            if(prev){
-                                prev->next = it->next;
-                            }
-                            delete it;
-                            break;
-                        }
-                        prev = it;
+                    float wordWidth = wordGlyphs == 0 ? 0 : wordAdvance * scale + (float)(wordGlyphs - 1) * m_textSettings.spacing;
+                    if(rowHasWord && wordGlyphs > 0 && rowWidth + wordWidth > maximumRowWidth){
+                        m_text[wordStart - 1] = '\n';
+                        m_lineStarts.push_back(wordStart);
+                        rowWidth = wordWidth;
                     }
-                }
-            };
-
-            float maximumRowWidth = marginForError * m_rect.width * (1 - 2 * m_textSettings.fontMargin.x);
-            WordList words = {nullptr, nullptr};
-            int wordSize = 0;
-
-            //Converts words into a list of strings and their widths
-            for(int i = 0; i <= m_text.size(); i++){
-                if(m_text[i] == '\n' || m_text[i] == ' ' || i == m_text.size()){
-                    if(m_text[i] == '\n') m_text[i] = ' ';
-                    char temp[wordSize+2];
-                    memcpy(temp, &m_text[i - wordSize], wordSize + 1);
-                    temp[wordSize+1] = 0;
-                    float width = MeasureTextEx(m_theme.font, temp, m_textSettings.fontSize, m_textSettings.spacing).x;
-                    Word *word = new Word;
-                    word->s = temp;
-                    word->width = width;
-                    if(word->width != -1) {
-                        //printf("Word: \"%s\" was just appended\n",word->s.c_str());
-                        words.append(word);
+                    else{
+                        rowWidth += wordWidth;
                     }
-                    wordSize = 0;
-                }
-                else{
-                    wordSize++;
-                }
-            }
+                    rowHasWord = true;
 
-            //iterate through words and add to text
-            for(Word *it = words.head; it->next != nullptr;){
-                auto next = it->next;
-                if(it->width + next->width <= maximumRowWidth){
-                    it->s += next->s;
-                    it->width += next->width;
-                    words.remove(next);
+                    i++;
+                    wordStart = i;
+                    wordAdvance = 0;
+                    wordGlyphs = 0;
                 }
                 else{
-                    it->s.pop_back();
-                    it->s += '\n';
-                    it = it->next;
+                    int codepointSize;
+                    int codepoint = GetCodepoint(&m_text[i], &codepointSize);
+                    wordAdvance += GetGlyphAdvance(font, codepoint);
+                    wordGlyphs++;
+                    i += codepointSize;
                 }
             }
-
-
-            m_text.clear();
-            for(Word *it = words.head; it != nullptr;it = it->next){
-                m_text += it->s;
-            }
-
-
-
         }
 
+        [[nodiscard]] const std::vector<size_t> &GetLineStarts() const {return m_lineStarts;}
+
         void DrawTextInRectangle(Rectangle rectangle,bool drawLines = false){
             Vector2 offset = {rectangle.x, rectangle.y};
-            Vector2 textSize = MeasureTextEx(m_theme.font, m_text.c_str(), m_textSettings.fontSize, m_textSettings.spacing);
+            Vector2 textSize = MeasureTextCached(GetTheme().font, m_text.c_str(), m_textSettings.fontSize, m_textSettings.spacing);
 
             switch(m_textSettings.horizontalAlign){
                 case TextAlign::Start:
@@ -608,14 +3475,14 @@ GuiElementState MouseDetection(Rectangle rect){
                     offset.y += rectangle.height - textSize.y - m_textSettings.fontMargin.y * rectangle.height;
                     break;
             }
-            DrawTextEx(m_theme.font, m_text.c_str(), offset, m_textSettings.fontSize, m_textSettings.spacing, m_theme.text[m_state]);
-            if(drawLines) DrawRectangleLines(offset.x,offset.y,textSize.x,textSize.y,GREEN);
+            DrawTextFast(GetTheme().font, m_text.c_str(), offset, m_textSettings.fontSize, m_textSettings.spacing, GetTheme().text[m_state]);
+            if(drawLines) DrawRectLines({offset.x,offset.y,textSize.x,textSize.y},1,GREEN);
 
         }
 
         void DrawTextInRectangle(bool drawLines = false){
             Vector2 offset = {m_rect.x, m_rect.y};
-            Vector2 textSize = MeasureTextEx(m_theme.font, m_text.c_str(), m_textSettings.fontSize, m_textSettings.spacing);
+            Vector2 textSize = MeasureTextCached(GetTheme().font, m_text.c_str(), m_textSettings.fontSize, m_textSettings.spacing);
 
             switch(m_textSettings.horizontalAlign){
                 case TextAlign::Start:
@@ -639,89 +3506,27 @@ GuiElementState MouseDetection(Rectangle rect){
                     offset.y += m_rect.height - textSize.y - m_textSettings.fontMargin.y * m_rect.height;
                     break;
             }
-            DrawTextEx(m_theme.font, m_text.c_str(), offset, m_textSettings.fontSize, m_textSettings.spacing, m_theme.text[m_state]);
-            if(drawLines) DrawRectangleLines(offset.x,offset.y,textSize.x,textSize.y,GREEN);
+            DrawTextFast(GetTheme().font, m_text.c_str(), offset, m_textSettings.fontSize, m_textSettings.spacing, GetTheme().text[m_state]);
+            if(drawLines) DrawRectLines({offset.x,offset.y,textSize.x,textSize.y},1,GREEN);
 
         }
 
         void FindMaxFontSize(Rectangle rectangle, float minimumFontSize = 0) {
-            m_textSettings.fontSize = rectangle.height;
-
-            Vector2 measuredSize = MeasureTextEx(m_theme.font, m_text.c_str(), m_textSettings.fontSize, m_textSettings.spacing);
-            while (measuredSize.x > rectangle.width * (1 - 2 * m_textSettings.fontMargin.x) ||
-                   measuredSize.y > rectangle.height * (1 - 2 * m_textSettings.fontMargin.y)) {
-                m_textSettings.fontSize -= 2;
-                m_textSettings.spacing = GET_SPACING(m_textSettings.fontSize);
-                measuredSize = MeasureTextEx(m_theme.font, m_text.c_str(), m_textSettings.fontSize, m_textSettings.spacing);
-            }
-            if(m_textSettings.fontSize < minimumFontSize) {
-                m_textSettings.fontSize = minimumFontSize;
-                m_textSettings.spacing = GET_SPACING(m_textSettings.fontSize);
-            }
+            FitFontSizeToRectangle(GetTheme().font, m_text.c_str(), &m_textSettings, rectangle, minimumFontSize);
+            MarkDirty();
         }
 
         void FindMaxFontSize(float minimumFontSize = 0) {
-            m_textSettings.fontSize = m_rect.height;
+            FitFontSizeToRectangle(GetTheme().font, m_text.c_str(), &m_textSettings, m_rect, minimumFontSize);
+            MarkDirty();
+        }
 
-            Vector2 measuredSize = MeasureTextEx(m_theme.font, m_text.c_str(), m_textSettings.fontSize, m_textSettings.spacing);
-            while (measuredSize.x > m_rect.width * (1 - 2 * m_textSettings.fontMargin.x) ||
-                   measuredSize.y > m_rect.height * (1 - 2 * m_textSettings.fontMargin.y)) {
-                m_textSettings.fontSize -= 2;
-                m_textSettings.spacing = GET_SPACING(m_textSettings.fontSize);
-                measuredSize = MeasureTextEx(m_theme.font, m_text.c_str(), m_textSettings.fontSize, m_textSettings.spacing);
-            }
-            if(m_textSettings.fontSize < minimumFontSize) {
-                m_textSettings.fontSize = minimumFontSize;
-                m_textSettings.spacing = GET_SPACING(m_textSettings.fontSize);
-            }
-        }
-
-        int FindLargestCharacterSize(bool (*filterFunction)(int) = IsAscii){
-            int maxSize = 0;
-            for(unsigned char key = 0; key < 255; key++){
-                if(filterFunction(key)){
-                    int index;
-                    int codepoint = GetCodepoint((char*)&key,&index); //don't care about codepointSize but can't do null due to segfault
-                    index = GetGlyphIndex(m_theme.font, codepoint);
-                    if(key != '\n'){
-                        int width;
-                        if(m_theme.font.glyphs[index].advanceX != 0){
-                            width = m_theme.font.glyphs[index].advanceX;
-                        }
-                        else{
-                            width = m_theme.font.recs[index].width + m_theme.font.glyphs[index].offsetX;
-                        }
-                        maxSize = std::max(maxSize,width);
-                    }
-                }
-            }
-            return maxSize;
+        int FindLargestCharacterSize(const CharacterFilter &filter = AsciiFilter){
+            return FindLargestGlyph(GetTheme().font, filter).advance;
         }
 
-        unsigned char FindLargestCharacter(bool (*filterFunction)(int) = IsAscii){
-            int maxSize = 0;
-            unsigned char biggest = 0;
-            for(unsigned char key = 0; key < 255; key++){
-                if(filterFunction(key)){
-                    int index;
-                    int codepoint = GetCodepoint((char*)&key,&index); //don't care about codepointSize but can't do null due to segfault
-                    index = GetGlyphIndex(m_theme.font,codepoint);
-                    if(key != '\n'){
-                        int width;
-                        if(m_theme.font.glyphs[index].advanceX!=0){
-                            width = m_theme.font.glyphs[index].advanceX;
-                        }
-                        else{
-                            width = m_theme.font.recs[index].width + m_theme.font.glyphs[index].offsetX;
-                        }
-                        if(width > maxSize){
-                            maxSize = width;
-                            biggest = key;
-                        }
-                    }
-                }
-            }
-            return biggest;
+        unsigned char FindLargestCharacter(const CharacterFilter &filter = AsciiFilter){
+            return FindLargestGlyph(GetTheme().font, filter).character;
         }
 
         TextSettings GetTextSettings(){
@@ -730,6 +3535,7 @@ GuiElementState MouseDetection(Rectangle rect){
 
         void SetTextSettings(TextSettings settings){
             m_textSettings = settings;
+            MarkDirty();
         }
 
         void TextGuiElementJsonFields(json &j){
@@ -761,12 +3567,13 @@ GuiElementState MouseDetection(Rectangle rect){
         int m_lastKey = 0;
         float m_minimumFontSize = 24;
         int m_characterLimit = 0;
+        size_t m_firstEdit = 0; // Earliest position edited since the last wrap, TextWrapFrom restarts near here
 
-        bool (*m_filterFunction)(int) = nullptr;
+        CharacterFilter m_filter = AsciiFilter;
 
 
         TextBox(Rectangle rect, std::string &text) : TextGuiElement(rect, text){
-            m_filterFunction = &IsAscii;
+            m_filter = AsciiFilter;
         };
 
         void TextBoxFromJson(json &j){
@@ -782,102 +3589,127 @@ GuiElementState MouseDetection(Rectangle rect){
             m_lastKey = j["lastKey"];
             m_minimumFontSize = j["minimumFontSize"];
             m_characterLimit = j["characterLimit"];
-            m_filterFunction = IsAscii;
+            m_filter = AsciiFilter;
+        }
+
+        TextBox(json &j) : TextGuiElement(j){
+            TextBoxFromJson(j);
+        }
+
+        ~TextBox() override{};
+
+        [[nodiscard]] bool HasPendingWork() override{
+            //A held key keeps repeating without new key presses
+            return HasFocus() && m_lastKey != 0;
+        }
+
+        [[nodiscard]] bool IsFocusable() override{
+            return m_state != Disabled;
         }
 
-        TextBox(json &j) : TextGuiElement(j){
-            TextBoxFromJson(j);
+        void FocusGained() override{
+            SetState(Pressed);
         }
 
-        ~TextBox() override{};
+        void FocusLost() override{
+            m_keyRepeatCount = 0;
+            m_lastKey = 0;
+            SetState(Normal);
+        }
 
-        void Update() override{
+        void Update(InputState &input) override{
+            //Typing arrives through KeyInput while the box has focus, only the mouse is handled here
             if(m_state == Disabled) return;
 
-            if(m_state==Pressed){
-                //Handle user input
-                if(!CheckCollisionPointRec(GetMousePosition(),m_rect) && IsMouseButtonPressed(MOUSE_LEFT_BUTTON)){
-                    m_state = Normal;
+            if(!HasFocus()){
+                //Check for mouse collision
+                if(input.MouseOver(m_rect)){
+                    if(input.IsMouseButtonPressed(MOUSE_LEFT_BUTTON)){
+                        Focus();
+                    }
+                    else{
+                        m_state = Focused;
+                    }
                 }
-                else if(IsKeyPressed(KEY_ENTER) && !IsKeyDown(KEY_LEFT_SHIFT)){
-                    //m_isTyping = false;
+                else{
                     m_state = Normal;
                 }
-                else{
-
-                    int input = GetKeyPressed();
-                    if(m_filterFunction(m_lastKey)){
-                        if(IsKeyDown(m_lastKey)){
-                            m_keyRepeatCount++;
-                        }
-                        else{
-                            m_keyRepeatCount = 0;
-                            m_lastKey = 0;
-                        }
+            }
+            ApplyTextChange();
+        }
 
-                        if(m_keyRepeatCount>=CONTINUOUS_TYPING_DELAY && !m_filterFunction(input)){
-                            input = m_lastKey;
-                        }
-                    }
-                    else{
-                        m_keyRepeatCount = 0;
-                        m_lastKey = 0;
-                    }
+        void KeyInput(InputState &input) override{
+            if(input.IsKeyPressed(KEY_ENTER) && !input.IsKeyDown(KEY_LEFT_SHIFT)){
+                Blur();
+                return;
+            }
 
-                    if(input == KEY_BACKSPACE){
-                        if(IsKeyDown(KEY_LEFT_CONTROL)){
-                            m_text.clear();
-                        }
-                        else if(!m_text.empty()) m_text.pop_back();
-                        m_hasTextChanged = true;
-                    }
-                    else if(m_characterLimit > 0 && m_text.size() >= m_characterLimit){
-                        m_text.resize(m_characterLimit);
-                        return;
-                    }
-                    else if(MACRO_SHIFT(m_filterFunction(KEY_ENTER)) &&!m_stringIsFull){
-                        m_text.push_back('\n');
-                        m_hasTextChanged = true;
-                    }
-                    else{
-                        if(m_filterFunction(input) && !m_stringIsFull){
-                            int shift = 32 * !IsKeyDown(KEY_LEFT_SHIFT);
-                            m_text.push_back((char)(input | shift));
-                            m_lastKey = input;
-                            m_hasTextChanged = true;
-                        }
+            int key = input.GetKeyPressed();
+            if(m_filter.Contains(m_lastKey)){
+                if(input.IsKeyDown(m_lastKey)){
+                    m_keyRepeatCount++;
+                }
+                else{
+                    m_keyRepeatCount = 0;
+                    m_lastKey = 0;
+                }
 
-                    }
+                if(m_keyRepeatCount>=CONTINUOUS_TYPING_DELAY && !m_filter.Contains(key)){
+                    key = m_lastKey;
                 }
             }
             else{
-                //Check for mouse collision
-                if(CheckCollisionPointRec(GetMousePosition(),m_rect)){
-                    if(IsMouseButtonPressed(MOUSE_LEFT_BUTTON)){
-                        m_state = Pressed;
-                    }
-                    else{
-                        m_state = Focused;
-                    }
+                m_keyRepeatCount = 0;
+                m_lastKey = 0;
+            }
+
+            if(key == KEY_BACKSPACE){
+                if(input.IsKeyDown(KEY_LEFT_CONTROL)){
+                    m_text.clear();
                 }
-                else{
-                    m_state = Normal;
+                else if(!m_text.empty()) m_text.pop_back();
+                m_firstEdit = std::min(m_firstEdit, m_text.size());
+                m_hasTextChanged = true;
+            }
+            else if(m_characterLimit > 0 && m_text.size() >= m_characterLimit){
+                m_text.resize(m_characterLimit);
+                m_firstEdit = std::min(m_firstEdit, m_text.size());
+                return;
+            }
+            else if(MACRO_SHIFT(input, m_filter.Contains(KEY_ENTER)) &&!m_stringIsFull){
+                m_firstEdit = std::min(m_firstEdit, m_text.size());
+                m_text.push_back('\n');
+                m_hasTextChanged = true;
+            }
+            else{
+                if(m_filter.Contains(key) && !m_stringIsFull){
+                    int shift = 32 * !input.IsKeyDown(KEY_LEFT_SHIFT);
+                    m_firstEdit = std::min(m_firstEdit, m_text.size());
+                    m_text.push_back((char)(key | shift));
+                    m_lastKey = key;
+                    m_hasTextChanged = true;
                 }
+
             }
+            ApplyTextChange();
+        }
 
+        void ApplyTextChange(){
+            //Refits the text after an edit
             if(m_hasTextChanged){
                 if(m_doAutoTextResize) {
                     FindMaxFontSize(m_minimumFontSize);
                     if(m_wrapAtMinFontSize && m_textSettings.fontSize <= m_minimumFontSize) m_doAutoTextWrap = true;
                 }
                 if(m_doAutoTextWrap) {
-                    TextWrap();
+                    TextWrapFrom(m_firstEdit);
+                    m_firstEdit = std::string::npos;
                     if(m_wrapAtMinFontSize &&  m_textSettings.fontSize > m_minimumFontSize) EnableAutoTextResize();
                 }
-                Vector2 measuredSize = MeasureTextEx(m_theme.font, m_text.c_str(), m_textSettings.fontSize, m_textSettings.spacing);
+                Vector2 measuredSize = MeasureTextCached(GetTheme().font, m_text.c_str(), m_textSettings.fontSize, m_textSettings.spacing);
                 if(m_text.back() == ' ') {
                     //If the text ends in a space, it is ignored to prevent "too big" triggering in weird cases
-                    measuredSize.x -= MeasureTextEx(m_theme.font," ",m_textSettings.fontSize,m_textSettings.spacing).x;
+                    measuredSize.x -= MeasureTextCached(GetTheme().font," ",m_textSettings.fontSize,m_textSettings.spacing).x;
                 }
                 if(measuredSize.x > m_rect.width * (1 - 2 * m_textSettings.fontMargin.x) ||
                    measuredSize.y > m_rect.height * (1 - 2 * m_textSettings.fontMargin.y)) {
@@ -890,22 +3722,22 @@ GuiElementState MouseDetection(Rectangle rect){
 
 
                 m_hasTextChanged = false;
+                MarkDirty();
             }
-
         }
 
         void Draw() override{
             if(m_drawBorder){
-                DrawRectangleRec(m_rect,m_theme.line[m_state]); //outer
-                DrawRectangle(m_rect.x+m_rect.width*m_textSettings.fontMargin.x,
-                              m_rect.y+m_rect.height*m_textSettings.fontMargin.y,
-                              m_rect.width*(1- 2 * m_textSettings.fontMargin.x),
-                              m_rect.height*(1- 2 * m_textSettings.fontMargin.y),
-                              m_theme.base[m_state]);
+                DrawRect(m_rect,GetTheme().line[m_state]); //outer
+                DrawRect({m_rect.x+m_rect.width*m_textSettings.fontMargin.x,
+                          m_rect.y+m_rect.height*m_textSettings.fontMargin.y,
+                          m_rect.width*(1- 2 * m_textSettings.fontMargin.x),
+                          m_rect.height*(1- 2 * m_textSettings.fontMargin.y)},
+                         GetTheme().base[m_state]);
                 }
             else{
-                DrawRectangleRec(m_rect, m_theme.base[m_state]);
-                DrawRectangleLinesEx(m_rect, m_theme.lineWidth, m_theme.line[m_state]);
+                DrawRect(m_rect, GetTheme().base[m_state]);
+                DrawRectLines(m_rect, GetTheme().lineWidth, GetTheme().line[m_state]);
             }
             DrawTextInRectangle();
 
@@ -916,14 +3748,14 @@ GuiElementState MouseDetection(Rectangle rect){
 
                 RTK::DrawTextInRectangle(buffer,
                                          {m_rect.x + m_rect.width * 0.9f, m_rect.y + m_rect.height * 0.9f,  m_rect.width * 0.1f,m_rect.height * 0.1f},
-                                         m_theme,{TextAlign::End,TextAlign::End,m_rect.height/10,{0.25,0.25},GET_SPACING(m_rect.height/10)},
+                                         GetTheme(),{TextAlign::End,TextAlign::End,m_rect.height/10,{0.25,0.25},GET_SPACING(m_rect.height/10)},
                                          m_state);
             }
         }
 
         void PrintDebugInfo(FILE *stream = stdout, bool showTextSettings = false, bool showConfigurableBool = false, bool showLastKeyInfo = false){
             fprintf(stream,"Text: \"%s\"\n",m_text.c_str());
-            Vector2 measuredSize = MeasureTextEx(m_theme.font, m_text.c_str(), m_textSettings.fontSize, m_textSettings.spacing);
+            Vector2 measuredSize = MeasureTextCached(GetTheme().font, m_text.c_str(), m_textSettings.fontSize, m_textSettings.spacing);
             fprintf(stream,"Measured Size: %f %f\n",measuredSize.x,measuredSize.y);
             fprintf(stream,"Rect: %f %f %f %f\n",m_rect.x,m_rect.y,m_rect.width,m_rect.height);
             switch (m_state) {
@@ -1014,10 +3846,12 @@ GuiElementState MouseDetection(Rectangle rect){
 
         void EnableDrawBorder(){
             m_drawBorder = true;
+            MarkDirty();
         }
 
         void DisableDrawBorder(){
             m_drawBorder = false;
+            MarkDirty();
         }
 
         bool IsTyping(){
@@ -1026,18 +3860,30 @@ GuiElementState MouseDetection(Rectangle rect){
 
         void SetText(std::string &text){
             m_text = text;
+            m_firstEdit = 0;
+            MarkDirty();
         }
 
         void SetTextLiteral(char *text){
             m_text = text;
+            m_firstEdit = 0;
+            MarkDirty();
+        }
+
+        void SetFilter(const CharacterFilter &filter){
+            m_filter = filter;
+        }
+
+        const CharacterFilter &GetFilter(){
+            return m_filter;
         }
 
         void SetFilterFunction(bool (*function)(int)){
-            m_filterFunction = function;
+            m_filter = CharacterFilter(function);
         }
 
         auto GetFilterFunction(){
-            return m_filterFunction;
+            return m_filter;
         }
 
         void SetCharacterLimit(int limit){
@@ -1050,10 +3896,12 @@ GuiElementState MouseDetection(Rectangle rect){
 
         void EnableDrawCharacterCount(){
             m_drawCharacterCount = true;
+            MarkDirty();
         }
 
         void DisableDrawCharacterCount(){
             m_drawCharacterCount = false;
+            MarkDirty();
         }
 
         void FixedTextSize(){
@@ -1064,12 +3912,9 @@ GuiElementState MouseDetection(Rectangle rect){
                 FindMaxFontSize();
             }
             else{
-                auto buffer = m_text;
-                char big = FindLargestCharacter(m_filterFunction);
-                m_text.clear();
-                for(int i = 0; i < m_characterLimit; i++) m_text += big;
-                FindMaxFontSize();
-                m_text = buffer;
+                //Sized for m_characterLimit copies of the widest character the filter lets through
+                LargestGlyph largest = FindLargestGlyph(GetTheme().font, m_filter);
+                FitFontSizeToGlyphRun(GetTheme().font, largest.advance, m_characterLimit, &m_textSettings, m_rect);
             }
         }
 
@@ -1113,14 +3958,19 @@ GuiElementState MouseDetection(Rectangle rect){
         ~CheckBox() override{};
 
         void Draw() override{
-            DrawRectangleRec(m_rect,m_theme.base[m_state]);
-            DrawRectangleLinesEx(m_rect,m_theme.lineWidth,m_theme.line[m_state]);
+            DrawResolved(GetTheme().base[m_state], GetTheme().line[m_state], GetTheme().lineWidth);
+        }
+
+        bool DrawResolved(Color base, Color line, float lineWidth) override{
+            DrawRect(m_rect,base);
+            DrawRectLines(m_rect,lineWidth,line);
+            return true;
         }
 
-        void Update() override{
+        void Update(InputState &input) override{
             bool hover = false;
-            if(CheckCollisionPointRec(GetMousePosition(),m_rect)){
-                if(IsMouseButtonPressed(MOUSE_LEFT_BUTTON)){
+            if(input.MouseOver(m_rect)){
+                if(input.IsMouseButtonPressed(MOUSE_LEFT_BUTTON)){
                     Toggle();
                 }
                 else{
@@ -1176,14 +4026,19 @@ GuiElementState MouseDetection(Rectangle rect){
         }
 
         void Draw() override{
-            DrawRectangleRec(m_rect,m_theme.base[m_state]);
-            DrawRectangleLinesEx(m_rect,m_theme.lineWidth,m_theme.line[m_state]);
+            DrawResolved(GetTheme().base[m_state], GetTheme().line[m_state], GetTheme().lineWidth);
+        }
+
+        bool DrawResolved(Color base, Color line, float lineWidth) override{
+            DrawRect(m_rect,base);
+            DrawRectLines(m_rect,lineWidth,line);
             if(!m_text.empty()) DrawTextInRectangle();
+            return true;
         }
-        void Update() override{
-            if(m_state == Pressed && IsMouseButtonReleased(MOUSE_LEFT_BUTTON)) m_function();
-            if(CheckCollisionPointRec(GetMousePosition(),m_rect)){
-                if(IsMouseButtonDown(MOUSE_LEFT_BUTTON)){
+        void Update(InputState &input) override{
+            if(m_state == Pressed && input.IsMouseButtonReleased(MOUSE_LEFT_BUTTON)) m_function();
+            if(input.MouseOver(m_rect)){
+                if(input.IsMouseButtonDown(MOUSE_LEFT_BUTTON)){
                     m_state = Pressed;
                 }
                 else{
@@ -1238,14 +4093,19 @@ GuiElementState MouseDetection(Rectangle rect){
         }
 
         void Draw() override{
-            DrawRectangleRec(m_rect,m_theme.base[m_state]);
-            DrawRectangleLinesEx(m_rect,m_theme.lineWidth,m_theme.line[m_state]);
+            DrawResolved(GetTheme().base[m_state], GetTheme().line[m_state], GetTheme().lineWidth);
+        }
+
+        bool DrawResolved(Color base, Color line, float lineWidth) override{
+            DrawRect(m_rect,base);
+            DrawRectLines(m_rect,lineWidth,line);
             if(!m_text.empty()) DrawTextInRectangle();
+            return true;
         }
-        void Update() override{
-            if(m_state == Pressed && IsMouseButtonReleased(MOUSE_LEFT_BUTTON)) m_function(m_defaultArgument);
-            if(CheckCollisionPointRec(GetMousePosition(),m_rect)){
-                if(IsMouseButtonDown(MOUSE_LEFT_BUTTON)){
+        void Update(InputState &input) override{
+            if(m_state == Pressed && input.IsMouseButtonReleased(MOUSE_LEFT_BUTTON)) m_function(m_defaultArgument);
+            if(input.MouseOver(m_rect)){
+                if(input.IsMouseButtonDown(MOUSE_LEFT_BUTTON)){
                     m_state = Pressed;
                 }
                 else{
@@ -1305,13 +4165,18 @@ GuiElementState MouseDetection(Rectangle rect){
         }
 
         void Draw() override{
-            DrawRectangleRec(m_rect,m_theme.base[m_state]);
-            DrawRectangleLinesEx(m_rect,m_theme.lineWidth,m_theme.line[m_state]);
+            DrawResolved(GetTheme().base[m_state], GetTheme().line[m_state], GetTheme().lineWidth);
+        }
+
+        bool DrawResolved(Color base, Color line, float lineWidth) override{
+            DrawRect(m_rect,base);
+            DrawRectLines(m_rect,lineWidth,line);
             if(!m_text.empty()) DrawTextInRectangle();
+            return true;
         }
-        void Update() override{
-            if(CheckCollisionPointRec(GetMousePosition(),m_rect)){
-                if(IsMouseButtonPressed(MOUSE_LEFT_BUTTON)){
+        void Update(InputState &input) override{
+            if(input.MouseOver(m_rect)){
+                if(input.IsMouseButtonPressed(MOUSE_LEFT_BUTTON)){
                     m_state = Pressed;
                     m_hasBeenpressed = true;
                 }
@@ -1322,9 +4187,9 @@ GuiElementState MouseDetection(Rectangle rect){
             }
             else m_state = Normal;
             return;
-            if(m_state == Pressed && IsMouseButtonReleased(MOUSE_LEFT_BUTTON)) m_hasBeenpressed = true;
-            if(CheckCollisionPointRec(GetMousePosition(),m_rect)){
-                if(IsMouseButtonDown(MOUSE_LEFT_BUTTON)){
+            if(m_state == Pressed && input.IsMouseButtonReleased(MOUSE_LEFT_BUTTON)) m_hasBeenpressed = true;
+            if(input.MouseOver(m_rect)){
+                if(input.IsMouseButtonDown(MOUSE_LEFT_BUTTON)){
                     m_state = Pressed;
                 }
                 else{
@@ -1335,6 +4200,13 @@ GuiElementState MouseDetection(Rectangle rect){
             else m_state = Normal;
         }
 
+        void SetLabel(const std::string &text){
+            //Replaces the text and fits it to the button again
+            if(m_text == text) return;
+            m_text = text;
+            FindMaxFontSize();
+        }
+
         [[nodiscard]] bool Poll(){
             bool temp = m_hasBeenpressed;
             m_hasBeenpressed = false;
@@ -1356,10 +4228,104 @@ GuiElementState MouseDetection(Rectangle rect){
 
     class Window : public TextGuiElement{
     protected:
-        std::vector<GuiElement*> m_elements;
+        std::vector<GuiElement*> m_elements; // In the order they were added, read through Children()
+        std::unordered_map<GuiElement*,size_t> m_positions; // Of each child in m_elements
+        size_t m_holes = 0; // Removed children left as nullptr in m_elements until Children() closes the gaps
+        size_t m_firstHole = 0;
+        UpdateScheduler m_scheduler; // Which of m_elements are updated each frame
         bool m_drawWindow = false;
         float m_headerSize = 0.075f;
 
+        bool m_retained = true; // Draw from m_cache, redrawn only after MarkDirty. Immediate mode draws every frame
+        bool m_cacheDirty = true;
+        RenderTexture2D m_cache = {0}; // The window's contents at its own size, id 0 when not allocated
+        uint32_t m_cacheThemeRevision = 0; // themeTable revision m_cache was drawn with
+
+        size_t CacheBytes(){
+            return (size_t)m_cache.texture.width * m_cache.texture.height * 4;
+        }
+
+        void ReleaseCache(){
+            if(m_cache.id == 0) return;
+            renderCacheBudget.Free(CacheBytes());
+            if(Backend().IsReady()) Backend().UnloadRenderTarget(m_cache);
+            m_cache = {0};
+        }
+
+        bool PrepareCache(){
+            //Makes m_cache match the window's size and contents, false if it has to be drawn immediately instead
+            int width = (int)std::ceil(m_rect.width);
+            int height = (int)std::ceil(m_rect.height);
+            if(width <= 0 || height <= 0) return false;
+            if(m_cache.id == 0 || m_cache.texture.width != width || m_cache.texture.height != height){
+                ReleaseCache();
+                size_t bytes = (size_t)width * height * 4;
+                if(!renderCacheBudget.Reserve(bytes)) return false;
+                m_cache = Backend().LoadRenderTarget(width, height);
+                if(m_cache.id == 0){
+                    renderCacheBudget.Free(bytes);
+                    m_cache = {0};
+                    return false;
+                }
+                m_cacheDirty = true;
+            }
+            if(m_cacheDirty || m_cacheThemeRevision != themeTable.GetRevision()){
+                BeginRenderTarget(m_cache, {drawOrigin.x + m_rect.x, drawOrigin.y + m_rect.y});
+                Backend().Clear(BLANK);
+                DrawContents();
+                EndRenderTarget();
+                renderCacheBudget.CountRender();
+                m_cacheDirty = false;
+                m_cacheThemeRevision = themeTable.GetRevision();
+            }
+            return true;
+        }
+
+        std::vector<GuiElement*> &Children(){
+            /* m_elements with the holes left by RemoveElement closed, which keeps removal O(1) without reordering the
+             * children. The gaps are closed all at once by the next pass over the children, which walks them anyway */
+            if(m_holes != 0){
+                m_elements.erase(std::remove(m_elements.begin() + m_firstHole, m_elements.end(), nullptr), m_elements.end());
+                for(size_t i = m_firstHole; i < m_elements.size(); i++) m_positions[m_elements[i]] = i;
+                m_holes = 0;
+            }
+            return m_elements;
+        }
+
+        virtual void DrawContents(){
+            if(m_drawWindow){
+                DrawRect(m_rect,GetTheme().background);
+                DrawRect({m_rect.x,m_rect.y,m_rect.width,m_rect.height*m_headerSize},GetTheme().base[m_state]);
+                DrawRectLines(m_rect,GetTheme().lineWidth,GetTheme().line[m_state]);
+                DrawTextInRectangle(GetHeaderRectangle());
+            }
+            DrawChildren();
+        }
+
+        void DrawChildren(){
+            //In the window's own coordinates, clipped to it
+            PushClip(m_rect);
+            PushOrigin(GetPosition());
+            for(auto e : Children()){
+                e->DrawClipped();
+            }
+            PopOrigin();
+            PopClip();
+        }
+
+        void UpdateChildren(InputState &input){
+            /* Only the children under the mouse or holding input, topmost first, with the mouse in their coordinates.
+             * Children are clipped to the window, outside it they see the mouse as consumed like they are not drawn */
+            Vector2 mouse = input.mouse;
+            bool consumed = input.mouseConsumed;
+            bool outside = !CheckCollisionPointRec(mouse, m_rect);
+            if(outside) input.ConsumeMouse();
+            input.mouse = {mouse.x - m_rect.x, mouse.y - m_rect.y};
+            m_scheduler.Dispatch(input);
+            input.mouse = mouse;
+            if(outside) input.mouseConsumed = consumed;
+        }
+
 
     public:
 
@@ -1389,6 +4355,18 @@ GuiElementState MouseDetection(Rectangle rect){
                     m_elements.push_back(new ButtonPoll(e["ButtonPoll"]));
                 }
             }
+            //Files from before children were stored relative to their window have them at screen positions
+            bool relative = j.value("relativeChildren", false);
+            for(size_t i = 0; i < m_elements.size(); i++){
+                m_positions[m_elements[i]] = i;
+            }
+            for(auto e : m_elements){
+                if(!relative) e->ShiftRect({-m_rect.x, -m_rect.y});
+                e->SetParent(this);
+                m_scheduler.Add(e);
+            }
+            m_retained = j.value("retained", true);
+            MarkDirty();
         }
 
         Window(json &j) : TextGuiElement(j){
@@ -1396,49 +4374,142 @@ GuiElementState MouseDetection(Rectangle rect){
         }
 
         ~Window(){
-            for(auto e : m_elements){
+            ReleaseCache();
+            for(auto e : Children()){
                 delete e;
             }
         }
 
-        void Draw(){
-            if(m_drawWindow){
-                DrawRectangleRec(m_rect,m_theme.background);
-                DrawRectangle(m_rect.x,m_rect.y,+m_rect.width,m_rect.height*m_headerSize,m_theme.base[m_state]);
-                DrawRectangleLinesEx(m_rect,m_theme.lineWidth,m_theme.line[m_state]);
-                DrawTextInRectangle(GetHeaderRectangle());
+        void Draw() override{
+            /* In retained mode the contents are drawn into m_cache when something marked the window dirty and the
+             * texture is drawn every frame after that, so moving the window costs a single blit. In either mode the
+             * contents are clipped to the window's rectangle and children outside it are not drawn at all.*/
+            if(!m_retained || !PrepareCache()){
+                DrawContents();
+                return;
             }
-            for(auto e : m_elements){
-                e->Draw();
+            DrawTexturedRect(m_cache.texture, {0, 0, (float)m_cache.texture.width, -(float)m_cache.texture.height},
+                             {m_rect.x, m_rect.y, (float)m_cache.texture.width, (float)m_cache.texture.height}, WHITE);
+            renderCacheBudget.CountBlit();
+        }
+
+        void Update(InputState &input) override{
+            UpdateChildren(input);
+        }
+
+        void MarkDirty() override{
+            m_cacheDirty = true;
+            GuiElement::MarkDirty();
+        }
+
+        void ChildChanged(GuiElement *child) override{
+            //The child already damaged its own area, only the cache needs redrawing
+            m_scheduler.Moved(child);
+            m_cacheDirty = true;
+            GuiElement::ChildChanged(child);
+        }
+
+        [[nodiscard]] bool HasPendingWork() override{
+            for(auto e : Children()){
+                if(e->HasPendingWork()) return true;
             }
+            return false;
         }
 
-        void Update() override{
-            for(auto e : m_elements){
-                e->Update();
+        [[nodiscard]] bool BlocksInput() override{
+            //A window that draws no background lets the mouse through to what is below it
+            return m_drawWindow && m_state != Disabled;
+        }
+
+        [[nodiscard]] bool HoldsInput() override{
+            return m_scheduler.HoldingInput();
+        }
+
+        [[nodiscard]] Vector2 ChildOrigin() override{
+            //Children are positioned relative to the window's corner, moving the window moves them for free
+            return GetPosition();
+        }
+
+        [[nodiscard]] bool IsOpaque() const {
+            //Whether the window's drawing hides everything behind its rectangle
+            return m_drawWindow && m_state != Disabled && GetTheme().background.a == 255;
+        }
+
+        void CollectFocusable(std::vector<GuiElement*> &elements) override{
+            if(m_state == Disabled) return;
+            for(auto e : Children()){
+                e->CollectFocusable(elements);
             }
         }
 
-        void AddElement(GuiElement *element){
+        void EnableRetainedMode(){
+            m_retained = true;
+            m_cacheDirty = true;
+        }
+
+        void DisableRetainedMode(){
+            //Immediate mode, the cache texture is given back to the budget
+            m_retained = false;
+            ReleaseCache();
+        }
+
+        [[nodiscard]] bool IsRetained() const {
+            return m_retained;
+        }
+
+        [[nodiscard]] bool IsCached() const {
+            return m_cache.id != 0;
+        }
+
+        ElementHandle AddElement(GuiElement *element){
+            /* element's rectangle is relative to the window's top left corner, and stays that way. The window owns
+             * element from now on, the handle stays safe to hold after it is removed or deleted */
+            m_positions[element] = m_elements.size();
             m_elements.push_back(element);
-            element->ShiftRect({m_rect.x,m_rect.y});
+            element->SetParent(this);
+            m_scheduler.Add(element);
+            MarkDirty();
+            return element->GetHandle();
         }
 
         void RemoveElement(GuiElement *element){
-            for(auto it = m_elements.begin(); it != m_elements.end(); it++){
-                if(*it == element){
-                    m_elements.erase(it);
-                    break;
-                }
-            }
+            //Ownership goes back to the caller
+            auto it = m_positions.find(element);
+            if(it == m_positions.end()) return;
+            element->BlurWithin();
+            size_t position = it->second;
+            m_positions.erase(it);
+            InvalidateRect(element->GetScreenBounds());
+            m_elements[position] = nullptr;
+            if(m_holes == 0 || position < m_firstHole) m_firstHole = position;
+            m_holes++;
+            m_scheduler.Remove(element);
+            element->SetParent(nullptr);
+            MarkDirty();
+        }
+
+        void RemoveElement(ElementHandle handle){
+            if(GuiElement *element = GetElement(handle)) RemoveElement(element);
+        }
+
+        [[nodiscard]] GuiElement *GetElement(ElementHandle handle){
+            //The child handle names, nullptr if it was deleted or is not a child of this window
+            GuiElement *element = elementHandles.Get(handle);
+            return element && m_positions.count(element) ? element : nullptr;
+        }
+
+        [[nodiscard]] size_t GetElementCount() const {
+            return m_positions.size();
         }
 
         void EnableDrawWindow(){
             m_drawWindow = true;
+            MarkDirty();
         }
 
         void DisableDrawWindow(){
             m_drawWindow = false;
+            MarkDirty();
         }
 
         Rectangle GetHeaderRectangle(){
@@ -1449,12 +4520,15 @@ GuiElementState MouseDetection(Rectangle rect){
             return m_rect.height*m_headerSize;
         }
 
-        void ShiftRect(Vector2 translation) override{
-            m_rect = {m_rect.x + translation.x, m_rect.y + translation.y, m_rect.width, m_rect.height};
-
-            for(auto e : m_elements){
-                e->ShiftRect(translation);
+        void ScaleRect(Vector2 scale) override{
+            //Scales the children's positions and sizes with the window's, about its top left corner
+            GuiElement::ScaleRect(scale);
+            for(auto e : Children()){
+                Rectangle r = e->GetRect();
+                e->SetRect({r.x * scale.x, r.y * scale.y, r.width, r.height});
+                e->ScaleRect(scale);
             }
+            FindMaxFontSize(GetHeaderRectangle());
         }
 
         void UpdateSizes(){
@@ -1470,7 +4544,7 @@ GuiElementState MouseDetection(Rectangle rect){
         void WriteDebugInfo(FILE *stream = stdout){
             fprintf(stream,"Window: %s\n",m_text.c_str());
             fwrite(this, sizeof(*this), 1, stream);
-            for(auto e : m_elements){
+            for(auto e : Children()){
                 e->WriteDebugInfo(stream);
             }
         }
@@ -1479,8 +4553,10 @@ GuiElementState MouseDetection(Rectangle rect){
             TextGuiElementJsonFields(j);
             j["headerSize"] = m_headerSize;
             j["drawWindow"] = m_drawWindow;
+            j["retained"] = m_retained;
+            j["relativeChildren"] = true;
             json elements;
-            for(auto e : m_elements){
+            for(auto e : Children()){
                 json temp;
                 e->ToJson(temp);
                 elements.push_back(temp);
@@ -1500,10 +4576,19 @@ GuiElementState MouseDetection(Rectangle rect){
         bool m_enableButtons = false;
         ButtonPoll m_delete = {{0,0,0,0},""};
         ButtonPoll m_minimize = {{0,0,0,0},""};
+
+        void PlaceButtons(){
+            //In the header's right quarter. Like the children, the buttons are relative to the window's corner
+            m_delete.SetRect({m_rect.width * 0.875f, 0, m_rect.width * 0.125f, m_headerSize * m_rect.height});
+            m_minimize.SetRect({m_rect.width * 0.75f, 0, m_rect.width * 0.125f, m_headerSize * m_rect.height});
+        }
+
     public:
         explicit DynamicWindow(Rectangle rect, std::string &name) : Window(rect, name) {
-            m_delete = ButtonPoll({m_rect.x + m_rect.width * 0.875f, m_rect.y,m_rect.width * 0.125f, m_headerSize * m_rect.height},"X");
-            m_minimize= ButtonPoll({m_rect.x + m_rect.width * 0.75f, m_rect.y,m_rect.width * 0.125f, m_headerSize * m_rect.height},"_");
+            m_delete = ButtonPoll({m_rect.width * 0.875f, 0, m_rect.width * 0.125f, m_headerSize * m_rect.height},"X");
+            m_minimize= ButtonPoll({m_rect.width * 0.75f, 0, m_rect.width * 0.125f, m_headerSize * m_rect.height},"_");
+            m_delete.SetParent(this);
+            m_minimize.SetParent(this);
             m_drawWindow = true;
         }
 
@@ -1512,112 +4597,516 @@ GuiElementState MouseDetection(Rectangle rect){
             m_enableButtons = j["enableButtons"];
             m_delete = ButtonPoll(j["deleteButton"]);
             m_minimize = ButtonPoll(j["minimizeButton"]);
+            m_delete.SetParent(this);
+            m_minimize.SetParent(this);
+            PlaceButtons();
         }
 
         DynamicWindow(json &j) : Window(j){
             DynamicWindowFromJson(j);
         }
 
-        void EnableButtons(){
-            m_enableButtons = true;
+        void EnableButtons(){
+            m_enableButtons = true;
+            MarkDirty();
+        }
+
+        Rectangle GetHeaderRectangle(){
+            if(m_enableButtons){
+                return {m_rect.x,m_rect.y,0.75f*m_rect.width,m_rect.height*m_headerSize};
+            }
+            return {m_rect.x,m_rect.y,+m_rect.width,m_rect.height*m_headerSize};
+        }
+
+        void DrawContents() override{
+            if(m_drawWindow){
+                DrawRect(m_rect,GetTheme().background);
+                DrawRect({m_rect.x,m_rect.y,m_rect.width,m_rect.height*m_headerSize},GetTheme().base[m_state]);
+                DrawRectLines(m_rect,GetTheme().lineWidth,GetTheme().line[m_state]);
+                DrawTextInRectangle(GetHeaderRectangle());
+                if(m_enableButtons){
+                    PushOrigin(GetPosition());
+                    m_delete.Draw();
+                    m_minimize.Draw();
+                    PopOrigin();
+                }
+            }
+            DrawChildren();
+        }
+
+        void Update(InputState &input) override{
+            if(m_state == Disabled) return;
+
+            if(m_enableButtons){
+                //Hidden buttons would still take the mouse over their end of the header
+                Vector2 mouse = input.mouse;
+                input.mouse = {mouse.x - m_rect.x, mouse.y - m_rect.y};
+                m_delete.UpdateTracked(input);
+                m_minimize.UpdateTracked(input);
+                input.mouse = mouse;
+            }
+
+            //Dragging by the header moves only the window's own rectangle, everything in it is relative to it
+            MouseDetection(input, GetHeaderRectangle());
+            Vector2 shift = input.mouseDelta;
+            if(m_state == Pressed){
+                m_rect = {m_rect.x + shift.x, m_rect.y + shift.y, m_rect.width, m_rect.height};
+            }
+            UpdateChildren(input);
+        }
+
+        void ScaleRect(Vector2 scale) override{
+            Window::ScaleRect(scale);
+            PlaceButtons();
+            m_delete.FindMaxFontSize();
+            m_minimize.FindMaxFontSize();
+        }
+
+        [[nodiscard]] bool HoldsInput() override{
+            //Being dragged by the header
+            return m_state == Pressed || Window::HoldsInput();
+        }
+
+        bool PollDelete(){
+            return m_delete.Poll();
+        }
+
+        bool PollMinimize(){
+            return m_minimize.Poll();
+        }
+
+        void UpdateSizes(){
+            FindMaxFontSize(GetHeaderRectangle());
+            PlaceButtons();
+            m_delete.FindMaxFontSize();
+            m_minimize.FindMaxFontSize();
+        }
+
+        void SetHeaderSize(float size){
+            m_headerSize = size;
+            UpdateSizes();
+        }
+
+        void DynamicWindowJsonFields(json &j){
+            WindowJsonFields(j);
+            j["enableButtons"] = m_enableButtons;
+            json deleteButton;
+            m_delete.ToJson(deleteButton);
+            j["deleteButton"] = deleteButton;
+            json minimizeButton;
+            m_minimize.ToJson(minimizeButton);
+            j["minimizeButton"] = minimizeButton;
+        }
+
+        void ToJson(json &j)override{
+            json temp;
+            DynamicWindowJsonFields(temp);
+            j["DynamicWindow"] = temp;
+        }
+
+    };
+
+    bool CheckDynamicWindowDrag(HeadlessBackend &backend, FILE *stream = stdout){
+        /* Drags a window without close and minimise buttons by either end of its header, it has to follow the mouse
+         * from anywhere on it. backend has to be the current one, see SetBackend. True if both drags moved it */
+        std::string name = "Drag";
+        bool passed = true;
+        for(float x : {150.0f, 450.0f}){
+            DynamicWindow window({100, 100, 400, 300}, name);
+            auto frame = [&](){
+                InputState input = InputState::Capture();
+                window.UpdateTracked(input);
+                backend.NextFrame();
+            };
+            backend.SetMousePosition({x, 105});
+            frame();
+            backend.PressMouseButton(MOUSE_BUTTON_LEFT);
+            frame();
+            for(int step = 1; step <= 4; step++){
+                backend.SetMousePosition({x + step * 10.0f, 105 + step * 10.0f});
+                frame();
+            }
+            backend.ReleaseMouseButton(MOUSE_BUTTON_LEFT);
+            frame();
+            Vector2 moved = {window.GetRect().x - 100, window.GetRect().y - 100};
+            fprintf(stream,"DynamicWindow drag from x=%.0f: moved %.0f,%.0f\n",x,moved.x,moved.y);
+            if(moved.x != 40 || moved.y != 40) passed = false;
+        }
+        return passed;
+    }
+
+#define ELEMENT_STORE_NONE SIZE_MAX // Slot index meaning no slot
+
+    class ElementStore : public GuiElement{
+        /* Container keeping its children's rectangles, states, themes, z-order and dirty bits in parallel arrays, so the
+         * per-frame passes (hover, culling, state colours) are loops over contiguous data instead of virtual calls
+         * through scattered objects. The widgets are views: they keep their own Update and Draw, the store copies a
+         * child's rectangle and state whenever it changes (through ChildChanged) and only calls into the children the
+         * passes pick. Draw resolves the state colours of changed slots in one pass and hands them to the children
+         * that can draw from them (DrawResolved). Meant for large flat sets of simple widgets. Children are never
+         * reordered in memory by z, a removal swaps the last slot into the hole. As in a Window, children are positioned
+         * relative to the store's corner, so moving the store leaves them and m_rects untouched */
+        std::vector<GuiElement*> m_views;
+        std::vector<Rectangle> m_rects; // Each view's bounds, relative to the store's position like the views themselves
+        std::vector<GuiElementState> m_states;
+        std::vector<ThemeId> m_themes;
+        std::vector<uint8_t> m_overridden; // Set when the view has a theme override, which m_themes does not cover
+        std::vector<uint32_t> m_z; // Higher is drawn later and hit first
+        std::vector<uint8_t> m_dirty; // Set when the slot changed since its colours were last resolved
+        std::vector<Color> m_base; // Resolved by ResolveColors
+        std::vector<Color> m_line;
+        std::vector<float> m_lineWidth;
+        std::unordered_map<GuiElement*, size_t> m_slots;
+        std::vector<size_t> m_visible; // Scratch for Draw
+        std::vector<GuiElement*> m_route; // Scratch for Update
+        ActiveSet m_active; // Children updated whether or not the mouse is over them, as in UpdateScheduler
+        GuiElement *m_hovered = nullptr;
+        uint32_t m_nextZ = 0;
+        uint32_t m_themeRevision = 0; // Of themeTable when every slot was last resolved, UpdateTheme changes it
+
+        void Sync(size_t slot){
+            GuiElement *view = m_views[slot];
+            m_rects[slot] = view->GetBounds();
+            m_states[slot] = view->GetState();
+            m_themes[slot] = view->GetThemeId();
+            m_overridden[slot] = view->HasThemeOverride();
+            m_dirty[slot] = 1;
+        }
+
+    public:
+        explicit ElementStore(Rectangle rect) : GuiElement(rect){}
+        ElementStore(const ElementStore&) = delete; // Children point at m_active
+
+        ~ElementStore() override{
+            for(auto view : m_views){
+                delete view;
+            }
+        }
+
+        void AddElement(GuiElement *element){
+            //Given relative to the store's position
+            element->SetParent(this);
+            m_slots[element] = m_views.size();
+            m_views.push_back(element);
+            m_rects.push_back({0, 0, 0, 0});
+            m_states.push_back(Normal);
+            m_themes.push_back(DefaultThemeId());
+            m_overridden.push_back(0);
+            m_z.push_back(m_nextZ++);
+            m_dirty.push_back(1);
+            m_base.push_back(BLANK);
+            m_line.push_back(BLANK);
+            m_lineWidth.push_back(0);
+            Sync(m_views.size() - 1);
+            element->SetActiveSet(&m_active);
+            m_active.Add(element);
+            MarkDirty();
+        }
+
+        void RemoveElement(GuiElement *element){
+            auto it = m_slots.find(element);
+            if(it == m_slots.end()) return;
+            element->BlurWithin();
+            size_t slot = it->second, last = m_views.size() - 1;
+            InvalidateRect(element->ToScreen(m_rects[slot]));
+            m_slots.erase(it);
+            if(slot != last){
+                m_views[slot] = m_views[last];
+                m_rects[slot] = m_rects[last];
+                m_states[slot] = m_states[last];
+                m_themes[slot] = m_themes[last];
+                m_overridden[slot] = m_overridden[last];
+                m_z[slot] = m_z[last];
+                m_dirty[slot] = m_dirty[last];
+                m_base[slot] = m_base[last];
+                m_line[slot] = m_line[last];
+                m_lineWidth[slot] = m_lineWidth[last];
+                m_slots[m_views[slot]] = slot;
+            }
+            m_views.pop_back();
+            m_rects.pop_back();
+            m_states.pop_back();
+            m_themes.pop_back();
+            m_overridden.pop_back();
+            m_z.pop_back();
+            m_dirty.pop_back();
+            m_base.pop_back();
+            m_line.pop_back();
+            m_lineWidth.pop_back();
+            if(m_hovered == element) m_hovered = nullptr;
+            m_active.Remove(element);
+            element->SetActiveSet(nullptr);
+            element->SetParent(nullptr);
+            MarkDirty();
+        }
+
+        void Raise(GuiElement *element){
+            //Draws the child above, and hits it before, every other child
+            auto it = m_slots.find(element);
+            if(it == m_slots.end()) return;
+            m_z[it->second] = m_nextZ++;
+            element->MarkDirty();
+        }
+
+        [[nodiscard]] size_t HitTest(Vector2 point) const {
+            //The topmost enabled slot containing point, relative to the store, ELEMENT_STORE_NONE if there is none
+            size_t hit = ELEMENT_STORE_NONE;
+            uint32_t hitZ = 0;
+            for(size_t i = 0; i < m_rects.size(); i++){
+                if(m_states[i] != Disabled && CheckCollisionPointRec(point, m_rects[i]) && (hit == ELEMENT_STORE_NONE || m_z[i] > hitZ)){
+                    hit = i;
+                    hitZ = m_z[i];
+                }
+            }
+            return hit;
+        }
+
+        void Cull(Rectangle clip, std::vector<size_t> &visible) const {
+            //The slots overlapping clip, relative to the store, bottom to top
+            visible.clear();
+            for(size_t i = 0; i < m_rects.size(); i++){
+                if(CheckCollisionRecs(m_rects[i], clip)) visible.push_back(i);
+            }
+            auto byZ = [this](size_t a, size_t b){ return m_z[a] < m_z[b]; };
+            //Slots stay in z order until a Raise or a removal, checking is cheaper than sorting
+            if(!std::is_sorted(visible.begin(), visible.end(), byZ)) std::sort(visible.begin(), visible.end(), byZ);
+        }
+
+        size_t ResolveColors(bool all = false){
+            //Looks up the base and line colour of each dirty slot (every slot if all) for its state, returns how many.
+            //Only children with a theme override are asked for their theme
+            size_t resolved = 0;
+            for(size_t i = 0; i < m_rects.size(); i++){
+                if(!all && !m_dirty[i]) continue;
+                const Theme &theme = m_overridden[i] ? m_views[i]->GetTheme() : themeTable.Get(m_themes[i]);
+                m_base[i] = theme.base[m_states[i]];
+                m_line[i] = theme.line[m_states[i]];
+                m_lineWidth[i] = theme.lineWidth;
+                m_dirty[i] = 0;
+                resolved++;
+            }
+            return resolved;
+        }
+
+        void Update(InputState &input) override{
+            //The topmost child under the mouse, the one under it last frame and the active ones, topmost first, with
+            //the mouse in their coordinates
+            Vector2 mouse = input.mouse;
+            input.mouse = {mouse.x - m_rect.x, mouse.y - m_rect.y};
+            size_t hit = input.mouseConsumed ? ELEMENT_STORE_NONE : HitTest(input.mouse);
+            GuiElement *hitView = hit == ELEMENT_STORE_NONE ? nullptr : m_views[hit];
+            m_route = m_active.GetElements();
+            for(auto view : {hitView, m_hovered}){
+                if(view && std::find(m_route.begin(), m_route.end(), view) == m_route.end()) m_route.push_back(view);
+            }
+            std::sort(m_route.begin(), m_route.end(), [this](GuiElement *a, GuiElement *b){
+                return m_z[m_slots[a]] > m_z[m_slots[b]];
+            });
+
+            schedulerStats.elements += m_views.size();
+            schedulerStats.active += m_active.Size();
+            schedulerStats.updated += m_route.size();
+            for(auto view : m_route){
+                view->UpdateTracked(input);
+                if(view->HoldsInput()) m_active.Add(view);
+                else m_active.Remove(view);
+            }
+            input.mouse = mouse;
+            m_hovered = hitView;
+        }
+
+        void Draw() override{
+            if(m_state == Disabled) return;
+            PushClip(m_rect);
+            PushOrigin(GetPosition());
+            Cull(CurrentClipRect(), m_visible);
+            cullStats.drawn += m_visible.size();
+            cullStats.culled += m_views.size() - m_visible.size();
+            bool themesChanged = themeTable.GetRevision() != m_themeRevision;
+            m_themeRevision = themeTable.GetRevision();
+            ResolveColors(themesChanged);
+            for(size_t slot : m_visible){
+                if(!m_views[slot]->DrawResolved(m_base[slot], m_line[slot], m_lineWidth[slot])) m_views[slot]->Draw();
+            }
+            PopOrigin();
+            PopClip();
+        }
+
+        void ChildChanged(GuiElement *child) override{
+            auto it = m_slots.find(child);
+            if(it != m_slots.end()) Sync(it->second);
+            GuiElement::ChildChanged(child);
+        }
+
+        [[nodiscard]] Vector2 ChildOrigin() override{
+            //Children are positioned relative to the store's corner, moving the store moves them for free
+            return GetPosition();
+        }
+
+        [[nodiscard]] bool BlocksInput() override{
+            //Only the children take the mouse
+            return false;
         }
 
-        Rectangle GetHeaderRectangle(){
-            if(m_enableButtons){
-                return {m_rect.x,m_rect.y,0.75f*m_rect.width,m_rect.height*m_headerSize};
-            }
-            return {m_rect.x,m_rect.y,+m_rect.width,m_rect.height*m_headerSize};
+        [[nodiscard]] bool HoldsInput() override{
+            return m_active.Size() != 0;
         }
 
-        void Draw() override{
-            if(m_drawWindow){
-                DrawRectangleRec(m_rect,m_theme.background);
-                DrawRectangle(m_rect.x,m_rect.y,+m_rect.width,m_rect.height*m_headerSize,m_theme.base[m_state]);
-                DrawRectangleLinesEx(m_rect,m_theme.lineWidth,m_theme.line[m_state]);
-                DrawTextInRectangle(GetHeaderRectangle());
-                if(m_enableButtons){
-                    m_delete.Draw();
-                    m_minimize.Draw();
-                }
-            }
-            for(auto e : m_elements){
-                e->Draw();
+        [[nodiscard]] bool HasPendingWork() override{
+            for(auto view : m_views){
+                if(view->HasPendingWork()) return true;
             }
+            return false;
         }
 
-        void Update() override{
+        void CollectFocusable(std::vector<GuiElement*> &elements) override{
             if(m_state == Disabled) return;
+            for(auto view : m_views){
+                view->CollectFocusable(elements);
+            }
+        }
 
-            m_delete.Update();
-            m_minimize.Update();
+        [[nodiscard]] size_t Size() const {
+            return m_views.size();
+        }
 
-            MouseDetection(GetHeaderRectangle());
-            Vector2 shift = GetMouseDelta();
+        [[nodiscard]] const std::vector<GuiElement*> &GetElements() const {
+            return m_views;
+        }
 
-            if(m_state == Pressed){
-                m_rect = {m_rect.x + shift.x, m_rect.y + shift.y, m_rect.width, m_rect.height};
-                m_delete.ShiftRect(shift);
-                m_minimize.ShiftRect(shift);
-            }
-            for(auto e : m_elements){
-                if(m_state == Pressed){
-                    e->ShiftRect(shift);
-                }
-                e->Update();
-            }
+        [[nodiscard]] const std::vector<Rectangle> &GetRects() const {
+            return m_rects;
         }
 
-        bool PollDelete(){
-            return m_delete.Poll();
+        [[nodiscard]] const std::vector<GuiElementState> &GetStates() const {
+            return m_states;
         }
 
-        bool PollMinimize(){
-            return m_minimize.Poll();
+        [[nodiscard]] const std::vector<Color> &GetBaseColors() const {
+            return m_base;
         }
 
-        void UpdateSizes(){
-            FindMaxFontSize(GetHeaderRectangle());
-            m_delete.SetRect({m_rect.x + m_rect.width * 0.875f, m_rect.y,m_rect.width * 0.125f, m_headerSize * m_rect.height});
-            m_minimize.SetRect({m_rect.x + m_rect.width * 0.75f, m_rect.y,m_rect.width * 0.125f, m_headerSize * m_rect.height});
-            m_delete.FindMaxFontSize();
-            m_minimize.FindMaxFontSize();
+        [[nodiscard]] const std::vector<Color> &GetLineColors() const {
+            return m_line;
         }
+    };
 
-        void SetHeaderSize(float size){
-            m_headerSize = size;
-            UpdateSizes();
+    void BenchmarkElementStore(int count = 100000, int frames = 100, FILE *stream = stdout){
+        /* Times the per-frame passes over count buttons kept as objects behind pointers, the way Window holds them,
+         * against the same passes over an ElementStore's arrays: the topmost button under the mouse, the buttons
+         * inside a clip rectangle and each button's colours for its state. The buttons are laid out in a grid and the
+         * mouse crosses it diagonally over the frames. Building and deleting each set is timed on its own.*/
+        const int columns = (int)std::ceil(std::sqrt((double)count));
+        const float size = 20;
+        Rectangle area = {0, 0, columns * size, columns * size};
+        Rectangle clip = {area.x + area.width / 4, area.y + area.height / 4, area.width / 2, area.height / 2};
+
+        std::vector<GuiElement*> objects;
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < count; i++){
+            Rectangle r = {(float)(i % columns) * size, (float)(i / columns) * size, size - 2, size - 2};
+            objects.push_back(new ButtonPoll(r, "b"));
+        }
+        auto objectSetup = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        auto store = new ElementStore({0, 0, area.width, area.height});
+        for(int i = 0; i < count; i++){
+            Rectangle r = {(float)(i % columns) * size, (float)(i / columns) * size, size - 2, size - 2};
+            store->AddElement(new ButtonPoll(r, "b"));
+        }
+        auto storeSetup = std::chrono::steady_clock::now() - start;
+
+        size_t objectHits = 0, objectVisible = 0, storeHits = 0, storeVisible = 0;
+        unsigned objectColor = 0, storeColor = 0;
+        std::vector<size_t> visible;
+        start = std::chrono::steady_clock::now();
+        for(int f = 0; f < frames; f++){
+            Vector2 mouse = {area.width * f / frames, area.height * f / frames};
+            GuiElement *hit = nullptr;
+            for(auto e : objects){
+                if(e->GetState() != Disabled && CheckCollisionPointRec(mouse, e->GetBounds())) hit = e;
+            }
+            if(hit) objectHits++;
+            for(auto e : objects){
+                if(CheckCollisionRecs(e->GetBounds(), clip)) objectVisible++;
+            }
+            for(auto e : objects){
+                objectColor += e->GetTheme().base[e->GetState()].r;
+            }
         }
+        auto objectTime = std::chrono::steady_clock::now() - start;
 
-        void DynamicWindowJsonFields(json &j){
-            WindowJsonFields(j);
-            j["enableButtons"] = m_enableButtons;
-            json deleteButton;
-            m_delete.ToJson(deleteButton);
-            j["deleteButton"] = deleteButton;
-            json minimizeButton;
-            m_minimize.ToJson(minimizeButton);
-            j["minimizeButton"] = minimizeButton;
+        start = std::chrono::steady_clock::now();
+        for(int f = 0; f < frames; f++){
+            Vector2 mouse = {area.width * f / frames, area.height * f / frames};
+            if(store->HitTest(mouse) != ELEMENT_STORE_NONE) storeHits++;
+            store->Cull(clip, visible);
+            storeVisible += visible.size();
+            store->ResolveColors(true);
+            for(const Color &c : store->GetBaseColors()) storeColor += c.r;
         }
+        auto storeTime = std::chrono::steady_clock::now() - start;
 
-        void ToJson(json &j)override{
-            json temp;
-            DynamicWindowJsonFields(temp);
-            j["DynamicWindow"] = temp;
+        start = std::chrono::steady_clock::now();
+        for(auto e : objects){
+            delete e;
         }
+        auto objectTeardown = std::chrono::steady_clock::now() - start;
 
-    };
+        start = std::chrono::steady_clock::now();
+        delete store;
+        auto storeTeardown = std::chrono::steady_clock::now() - start;
+
+        auto ms = [](std::chrono::steady_clock::duration d){ return std::chrono::duration<double,std::milli>(d).count(); };
+        fprintf(stream,"ElementStore: %d buttons, %d frames\n",count,frames);
+        fprintf(stream,"Objects: %f ms per frame, %f ms setup, %f ms teardown\n",ms(objectTime) / frames,ms(objectSetup),ms(objectTeardown));
+        fprintf(stream,"Store: %f ms per frame, %f ms setup, %f ms teardown\n",ms(storeTime) / frames,ms(storeSetup),ms(storeTeardown));
+        if(objectHits != storeHits || objectVisible != storeVisible || objectColor != storeColor) fprintf(stream,"Results differ\n");
+    }
 
     class WindowManager : public GuiElement {
+        /* Windows are kept in a stack, bottom to top. They are drawn bottom-up and updated top-down, and the first
+         * enabled window under the mouse takes it, so overlapping windows never react to the same click. Clicking a
+         * window raises it to the top. m_windows keeps the order windows were added in, for the task bar buttons */
     private:
         struct WindowModule{
             DynamicWindow *window;
             ButtonPoll *button;
         };
+        typedef std::list<WindowModule>::iterator ModuleIterator;
 
-
-        std::vector<WindowModule> m_windows;
+        std::list<WindowModule> m_stack; // Bottom to top, raising a window is a splice
+        std::vector<ModuleIterator> m_windows; // Task bar order
         float m_footerSize = 0.05f;
         int m_maxWindows = 10;
+
+        void Attach(DynamicWindow *window){
+            Rectangle buttonRec = {m_windows.size() * (m_rect.width / m_maxWindows), (1 - m_footerSize) * m_rect.height, (m_rect.width / m_maxWindows), m_rect.height * m_footerSize};
+            auto but = new ButtonPoll(buttonRec,window->m_text);
+            window->SetParent(this);
+            but->SetParent(this);
+            m_stack.push_back({window,but});
+            m_windows.push_back(std::prev(m_stack.end()));
+        }
+
+        void Raise(ModuleIterator module){
+            if(std::next(module) == m_stack.end()) return;
+            m_stack.splice(m_stack.end(), m_stack, module);
+            //Its area is drawn again with it on top, its own contents did not change
+            InvalidateRect(module->window->GetScreenBounds());
+            GuiElement::ChildChanged(module->window);
+        }
+
+        bool Occluded(ModuleIterator module){
+            //Whether a single opaque window above covers all of it
+            Rectangle bounds = module->window->GetBounds();
+            for(auto above = std::next(module); above != m_stack.end(); above++){
+                if(above->window->IsOpaque() && RectangleContains(above->window->GetRect(), bounds)) return true;
+            }
+            return false;
+        }
+
     public:
         WindowManager(Rectangle rectangle, float footerSize, int maxWindows) : GuiElement(rectangle){
             m_footerSize = footerSize;
@@ -1630,7 +5119,7 @@ GuiElementState MouseDetection(Rectangle rect){
             m_maxWindows = j["maxWindows"];
             json windows = j["windows"];
             for(auto w : windows){
-                m_windows.push_back({new DynamicWindow(w),new ButtonPoll({0,0,0,0},"")});
+                Attach(new DynamicWindow(w));
             }
         }
 
@@ -1639,7 +5128,7 @@ GuiElementState MouseDetection(Rectangle rect){
         }
 
         ~WindowManager() override{
-            for(auto m : m_windows){
+            for(auto &m : m_stack){
                 delete m.window;
                 delete m.button;
             }
@@ -1647,69 +5136,115 @@ GuiElementState MouseDetection(Rectangle rect){
 
         void Draw() override{
             if(m_state==Disabled)return;
-            for(auto m_window : m_windows){
+            PushClip(m_rect);
+            for(auto it = m_stack.begin(); it != m_stack.end(); it++){
+                if(it->window->GetState() == Disabled) continue;
+                if(Occluded(it)){
+                    cullStats.culled++;
+                    continue;
+                }
+                it->window->DrawClipped();
+            }
+            for(auto m : m_windows){
+                m->button->DrawClipped();
+            }
+            PopClip();
 
-                Rectangle r = m_window.window->GetRect();
+            DrawRectLines(m_rect, GetTheme().lineWidth, GetTheme().line[Normal]);
 
-                switch(m_window.window->GetState()){
-                    case Disabled:
-                        break;
-                    case Normal:
-                    case Focused:
-                    case Pressed:
-                        m_window.window->Draw();
-                        break;
-                }
+        }
 
-                m_window.button->Draw();
+        [[nodiscard]] bool HasPendingWork() override{
+            for(auto &m : m_stack){
+                if(m.window->HasPendingWork()) return true;
             }
-            EndTextureMode();
+            return false;
+        }
 
-            DrawRectangleLinesEx(m_rect, m_theme.lineWidth, m_theme.line[Normal]);
+        [[nodiscard]] bool BlocksInput() override{
+            //Only the windows and their buttons take the mouse, which they consume themselves
+            return false;
+        }
 
+        void CollectFocusable(std::vector<GuiElement*> &elements) override{
+            if(m_state == Disabled) return;
+            for(auto m : m_windows){
+                m->window->CollectFocusable(elements);
+            }
         }
 
-        void Update() override{
+        void Update(InputState &input) override{
             if(m_state==Disabled)return;
-            for (auto it = m_windows.begin(); it != m_windows.end(); ) {
+            ModuleIterator raise = m_stack.end();
 
-                it->window->Update();
-                if (it->window->PollMinimize()) {
-                    it->window->Disable();
-                    it->button->SetState(GuiElementState::Focused);
+            //The task bar is above every window
+            for(auto m : m_windows){
+                m->button->UpdateTracked(input);
+                if(m->button->Poll()){
+                    m->window->ToggleState();
+                    if(m->window->GetState() != Disabled) raise = m;
                 }
-                it->button->Update();
-                if (it->button->Poll()) {
-                    it->window->ToggleState();
+            }
+
+            //Top-down, the first enabled window under the mouse takes it
+            for(auto it = m_stack.end(); it != m_stack.begin(); ){
+                --it;
+                DynamicWindow *window = it->window;
+                bool hit = window->GetState() != Disabled && input.MouseOver(window->GetBounds());
+                if(hit && input.IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) raise = it;
+                window->UpdateTracked(input);
+                if(hit) input.ConsumeMouse();
+
+                if (window->PollMinimize()) {
+                    window->Disable();
+                    it->button->SetState(GuiElementState::Focused);
                 }
-                if (it->window->PollDelete()) {
-                    // Properly delete the element and advance the iterator
-                    it = m_windows.erase(it);
-                } else {
-                    ++it;
+                if (window->PollDelete()) {
+                    //The manager owns both, handles to the window resolve to nullptr from here on
+                    InvalidateRect(window->GetScreenBounds());
+                    InvalidateRect(it->button->GetScreenBounds());
+                    if(raise == it) raise = m_stack.end();
+                    m_windows.erase(std::find(m_windows.begin(), m_windows.end(), it));
+                    delete window;
+                    delete it->button;
+                    it = m_stack.erase(it);
                 }
             }
+
+            if(raise != m_stack.end()) Raise(raise);
         }
 
 
 
         bool AddWindow(DynamicWindow *window){
+            //On top of the windows already added
             if(m_windows.size() == m_maxWindows) return false;
             window->EnableButtons();
-            auto size = window->GetSize();
             window->ShiftRect({m_rect.x, m_rect.y});
-            Rectangle buttonRec = {m_windows.size() * (m_rect.width / m_maxWindows), (1 - m_footerSize) * m_rect.height, (m_rect.width / m_maxWindows), m_rect.height * m_footerSize};
-            auto but = new ButtonPoll(buttonRec,window->m_text);
-            m_windows.push_back({window,but});
+            Attach(window);
             return true;
         }
 
+        void RaiseWindow(DynamicWindow *window){
+            for(auto m : m_windows){
+                if(m->window == window){
+                    Raise(m);
+                    return;
+                }
+            }
+        }
+
+        [[nodiscard]] DynamicWindow *GetTopWindow(){
+            //The topmost window, enabled or not, nullptr when there are none
+            return m_stack.empty() ? nullptr : m_stack.back().window;
+        }
+
 
         void WriteDebugInfo(FILE *stream = stdout){
             fprintf(stream,"Window Manager\n");
             fwrite(this, sizeof(*this), 1, stream);
             for(auto m : m_windows){
-                m.window->WriteDebugInfo(stream);
+                m->window->WriteDebugInfo(stream);
             }
         }
 
@@ -1720,7 +5255,7 @@ GuiElementState MouseDetection(Rectangle rect){
             json windows;
             for(auto m : m_windows){
                 json temp;
-                m.window->ToJson(temp);
+                m->window->ToJson(temp);
                 windows.push_back(temp);
             }
             j["windows"] = windows;
@@ -1735,18 +5270,53 @@ GuiElementState MouseDetection(Rectangle rect){
 
     };
 
+#define DROPDOWN_VISIBLE_ROWS 8 // Options listed below an expanded dropdown at a time
+
     class Dropdown : public TextGuiElement{
-        struct ButtonNode{
-            ButtonPoll *button;
-            ButtonNode *next;
-        };
-        struct ButtonList{
-            ButtonNode *head;
-            ButtonNode *tail;
-        };
+        /* Collapsed, the dropdown shows its selected option in m_rect. Expanded, the options from m_firstRow on are
+         * listed below it, one row each. The options are only strings, the row buttons are created the first time they
+         * are shown and reused for whichever options are scrolled into view, so a long list costs one string each */
+        ButtonPoll m_header = {{0,0,0,0},""}; // Shows the selected option
+        std::vector<ButtonPoll*> m_rows; // Never more than m_visibleRows
+
+        void InitHeader(){
+            m_header.SetRect(m_rect);
+            m_header.SetParent(this);
+            UpdateHeader();
+        }
+
+        void UpdateHeader(){
+            m_header.SetLabel(m_options.empty() ? std::string() : m_options[m_selected]);
+        }
+
+        [[nodiscard]] size_t ShownRows() const {
+            if(m_firstRow >= m_options.size()) return 0;
+            return std::min((size_t)m_visibleRows, m_options.size() - m_firstRow);
+        }
+
+        [[nodiscard]] Rectangle RowRectangle(size_t row) const {
+            return {m_rect.x, m_rect.y + m_rect.height * (float)(row + 1), m_rect.width, m_rect.height};
+        }
+
+        void LayoutRows(){
+            //Points the shown rows at their options, creating the buttons missing
+            size_t shown = ShownRows();
+            while(m_rows.size() < shown){
+                auto row = new ButtonPoll({0,0,0,0},"");
+                row->SetParent(this);
+                m_rows.push_back(row);
+            }
+            for(size_t r = 0; r < shown; r++){
+                m_rows[r]->SetRect(RowRectangle(r));
+                m_rows[r]->SetLabel(m_options[m_firstRow + r]);
+            }
+        }
 
     public:
-        ButtonList m_options;
+        std::vector<std::string> m_options;
+        size_t m_selected = 0; // Index into m_options, 0 while it is empty
+        size_t m_firstRow = 0; // The option in the first row when expanded
+        int m_visibleRows = DROPDOWN_VISIBLE_ROWS;
         bool m_isExpanded = false;
         int m_maxOptions = 0;
         bool m_enableScrollBar = false;
@@ -1755,8 +5325,7 @@ GuiElementState MouseDetection(Rectangle rect){
 
         Dropdown(Rectangle rect, std::string text) : TextGuiElement(rect, text){
             FindMaxFontSize();
-            m_options.head = nullptr;
-            m_options.tail = nullptr;
+            InitHeader();
         }
 
         void DropdownFromJson(json &j){
@@ -1765,13 +5334,21 @@ GuiElementState MouseDetection(Rectangle rect){
             m_maxOptions = j["maxOptions"];
             m_enableScrollBar = j["enableScrollBar"];
             m_enableScrollBarWhenFull = j["enableScrollBarWhenFull"];
-            json options = j["options"];
-            for(auto o : options){
-                m_options.head = new ButtonNode;
-                m_options.head->button = new ButtonPoll(o);
-                m_options.head->next = nullptr;
-                m_options.tail = m_options.head;
+            m_selected = j.value("selected", (size_t)0);
+            m_options.clear();
+            for(auto &o : j["options"]){
+                if(o.is_string()){
+                    m_options.push_back(o);
+                }
+                else{
+                    //Older files stored each option as a ButtonPoll, the selected one first
+                    const json &button = o.contains("ButtonPoll") ? o["ButtonPoll"] : o;
+                    m_options.push_back(button["text"]);
+                }
             }
+            if(m_selected >= m_options.size()) m_selected = 0;
+            InitHeader();
+            if(m_isExpanded) Expand();
         }
 
         Dropdown(json &j) : TextGuiElement(j){
@@ -1779,95 +5356,125 @@ GuiElementState MouseDetection(Rectangle rect){
         }
 
         ~Dropdown() override{
-            while(m_options.head){
-                delete m_options.head->button;
-                auto temp = m_options.head;
-                m_options.head = m_options.head->next;
-                delete temp;
+            for(auto row : m_rows){
+                delete row;
             }
         }
 
+        Rectangle GetBounds() override{
+            //Expanded, the rows hang below the dropdown's own rectangle
+            if(!m_isExpanded) return m_rect;
+            return {m_rect.x, m_rect.y, m_rect.width, m_rect.height * (float)(ShownRows() + 1)};
+        }
+
         void Draw() override{
+            if(m_options.empty()) return;
+            m_header.Draw();
             if(m_isExpanded){
-                for(ButtonNode *node = m_options.head; node != nullptr; node = node->next){
-                    node->button->Draw();
+                size_t shown = std::min(ShownRows(), m_rows.size());
+                for(size_t r = 0; r < shown; r++){
+                    m_rows[r]->Draw();
                 }
             }
-            else{
-                if(m_options.head) m_options.head->button->Draw();
-            }
-
         }
 
         void ShiftRect(Vector2 translation) override{
             m_rect = {m_rect.x + translation.x, m_rect.y + translation.y, m_rect.width, m_rect.height};
-
-            for(ButtonNode *node = m_options.head; node != nullptr; node = node->next){
-                node->button->ShiftRect(translation);
+            m_header.ShiftRect(translation);
+            for(auto row : m_rows){
+                row->ShiftRect(translation);
             }
         }
 
-        void OrderOptions(){
-            Rectangle rectangle = m_rect;
-            for(ButtonNode *node = m_options.head; node != nullptr; node = node->next){
-                node->button->SetRect(rectangle);
-                rectangle.y += rectangle.height;
+        void AddOption(const std::string &optionName){
+            if(m_maxOptions != 0 && m_options.size() >= (size_t)m_maxOptions) return;
+            Rectangle bounds = GetBounds();
+            m_options.push_back(optionName);
+            bool first = m_options.size() == 1;
+            bool shown = m_isExpanded && m_options.size() <= m_firstRow + m_visibleRows;
+            if(!first && !shown) return;
+            if(first) UpdateHeader();
+            if(shown) LayoutRows(); //Including the first option, when the dropdown was expanded empty
+            //An expanded list grows by a row, which the parent has to know about
+            MarkMoved(bounds);
+        }
 
-            }
+        void Select(size_t index){
+            if(index >= m_options.size() || index == m_selected) return;
+            m_selected = index;
+            UpdateHeader();
+            MarkDirty();
+        }
+
+        [[nodiscard]] size_t GetSelected() const {
+            return m_selected;
+        }
+
+        [[nodiscard]] const std::string &GetSelectedOption() const {
+            //Only while there are options
+            return m_options[m_selected];
+        }
+
+        [[nodiscard]] size_t GetOptionCount() const {
+            return m_options.size();
         }
 
-        void AddOption(std::string &optionName){
-            Rectangle rectangle = m_rect;
-            int size = 0;
-            for(ButtonNode *node = m_options.head; node != nullptr; node = node->next){size++;}
-            if(m_maxOptions != 0 && size >= m_maxOptions) return;
-            rectangle.y += rectangle.height * size;
-            auto but = new ButtonPoll(rectangle,optionName);
-            auto node = new ButtonNode;
-            node->button = but;
-            node->next = nullptr;
-            if(!m_options.head) m_options.head = node;
-            if(m_options.tail) m_options.tail->next = node;
-            m_options.tail = node;
+        void Expand(){
+            //Scrolls the selected option into view
+            m_isExpanded = true;
+            if(m_selected < m_firstRow || m_selected >= m_firstRow + m_visibleRows) m_firstRow = m_selected;
+            ScrollOptions(0);
         }
 
-        void Update() override{
-            MouseDetection();
+        void Collapse(){
+            InvalidateRect(GetScreenBounds());
+            m_isExpanded = false;
+            MarkDirty();
+        }
+
+        void ScrollOptions(int rows){
+            //Moves the listed options by rows, keeping the list full where there are enough options
+            InvalidateRect(GetScreenBounds());
+            size_t last = m_options.size() > (size_t)m_visibleRows ? m_options.size() - m_visibleRows : 0;
+            long first = (long)m_firstRow + rows;
+            m_firstRow = first < 0 ? 0 : std::min((size_t)first, last);
+            if(m_isExpanded) LayoutRows();
+            MarkDirty();
+        }
+
+        void Update(InputState &input) override{
+            MouseDetection(input);
+            if(m_options.empty()) return;
 
             if(m_isExpanded){
-                ButtonNode *prev = nullptr;
-                for(ButtonNode *node = m_options.head; node != nullptr; node = node->next){
-                    node->button->Update();
-                    if(node->button->Poll()){
-                        if(prev) prev->next = node->next;
-                        if(node!=m_options.head) {
-                            node->next = m_options.head;
-                            m_options.head = node;
-                        }
-                        OrderOptions();
-                        m_isExpanded = false;
-                        break;
+                //The wheel over the list scrolls it, a notch a row
+                float wheel = input.GetMouseWheelMove();
+                if(wheel != 0 && input.MouseOver(GetBounds())){
+                    int rows = (int)std::lround(-wheel);
+                    ScrollOptions(rows != 0 ? rows : (wheel > 0 ? -1 : 1));
+                }
+                size_t shown = std::min(ShownRows(), m_rows.size());
+                for(size_t r = 0; r < shown; r++){
+                    m_rows[r]->UpdateTracked(input);
+                    if(m_rows[r]->Poll()){
+                        Select(m_firstRow + r);
+                        Collapse();
+                        return;
                     }
-                    prev = node;
                 }
+                m_header.UpdateTracked(input);
+                if(m_header.Poll()) Collapse();
             }
             else{
-                if(m_options.head) {
-                    m_options.head->button->Update();
-                    if(m_options.head->button->Poll()){
-                        m_isExpanded = true;
-                    }
-                }
-
+                m_header.UpdateTracked(input);
+                if(m_header.Poll()) Expand();
             }
-
-
         }
 
         void WriteDebugInfo(FILE *stream = stdout){
             fwrite(this,sizeof(Dropdown),1,stream);
-            for(ButtonNode *node = m_options.head; node != nullptr; node = node->next){
-                node->button->WriteDebugInfo(stream);
+            for(auto &o : m_options){
+                fprintf(stream,"%s\n",o.c_str());
             }
         }
 
@@ -1877,13 +5484,8 @@ GuiElementState MouseDetection(Rectangle rect){
             j["maxOptions"] = m_maxOptions;
             j["enableScrollBar"] = m_enableScrollBar;
             j["enableScrollBarWhenFull"] = m_enableScrollBarWhenFull;
-            json options;
-            for(ButtonNode *node = m_options.head; node != nullptr; node = node->next){
-                json temp;
-                node->button->ToJson(temp);
-                options.push_back(temp);
-            }
-            j["options"] = options;
+            j["options"] = m_options;
+            j["selected"] = m_selected;
         }
 
         void ToJson(json &j)override{
@@ -1902,10 +5504,23 @@ GuiElementState MouseDetection(Rectangle rect){
     public:
         //Not necessary, but simplifies the process and allows for easy use of json files
 
+        ElementArena m_layoutArena; // Holds the elements loaded from json, declared first so it is released last
         std::vector<GuiElement*> m_elements;
+        std::unordered_set<GuiElement*> m_loaded; // The elements the runtime created and deletes, removed ones included
+        UpdateScheduler m_scheduler; // Which of m_elements are updated each frame
         std::unordered_map<std::string,std::fstream> m_files;
         json m_json;
 
+        bool m_batchDraws = true; // Record each frame into drawList and submit it grouped by texture
+        bool m_partialRedraw = false; // Keep the frame in m_canvas and redraw only damaged regions of it
+        bool m_outlineDamage = false; // Debug, outline the regions redrawn each frame
+        Color m_background = LIGHTGRAY; // Damaged regions are cleared to this before redrawing
+        RenderTexture2D m_canvas = {0};
+        DamageStats m_damageStats = {0, 0, 0};
+        CullStats m_cullStats = {0, 0}; // Last frame's
+        SchedulerStats m_schedulerStats = {0, 0, 0}; // Last update's
+        std::vector<Rectangle> m_lastDamage;
+
 
         RTKRuntime() = default;
 
@@ -1919,11 +5534,35 @@ GuiElementState MouseDetection(Rectangle rect){
             for(auto &f : m_files){
                 f.second.close();
             }
+            if(m_canvas.id != 0 && Backend().IsReady()) Backend().UnloadRenderTarget(m_canvas);
+            //The runtime created the elements it loaded, elements added with AddElement belong to the caller
+            for(auto e : m_loaded){
+                delete e;
+            }
         }
 
 
-        void AddElement(GuiElement *element){
+        ElementHandle AddElement(GuiElement *element){
             m_elements.push_back(element);
+            m_scheduler.Add(element);
+            InvalidateRect(element->GetBounds());
+            return element->GetHandle();
+        }
+
+        void RemoveElement(GuiElement *element){
+            /* Ownership of elements added with AddElement stays with the caller. An element loaded from json is only
+             * detached, the runtime still owns it and deletes it with the rest of the layout, so the caller must not
+             * delete it. The top level is short, a scan is fine */
+            auto it = std::find(m_elements.begin(), m_elements.end(), element);
+            if(it == m_elements.end()) return;
+            element->BlurWithin();
+            InvalidateRect(element->GetBounds());
+            m_elements.erase(it);
+            m_scheduler.Remove(element);
+        }
+
+        void RemoveElement(ElementHandle handle){
+            if(GuiElement *element = elementHandles.Get(handle)) RemoveElement(element);
         }
 
         void RegisterFile(const std::string &path, const std::string &alias){
@@ -1948,6 +5587,8 @@ GuiElementState MouseDetection(Rectangle rect){
 
     private: void FromJson(){
             json elements = m_json["RTKRuntime"]["elements"];
+            ElementArenaScope arenaScope(m_layoutArena); // The whole layout, children included, is laid out together
+            size_t first = m_elements.size();
             //std::cout<<"This is the json file"<<elements<<std::endl;
             for(auto &element : elements){ //Currently, this goes inside of "GuiElement":{} each time, thus it can't use the key
 
@@ -1980,6 +5621,10 @@ GuiElementState MouseDetection(Rectangle rect){
                 }
                 //m_elements.push_back(m_constructorMap[element.key()](element.value()));
             }
+            m_loaded.insert(m_elements.begin() + (long)first, m_elements.end());
+            m_scheduler.Clear();
+            for(auto e : m_elements) m_scheduler.Add(e);
+            InvalidateScreen();
         }
     public:
         void SaveJson(const std::string &alias){
@@ -2006,18 +5651,411 @@ GuiElementState MouseDetection(Rectangle rect){
         }
 
         void Update(){
-            for(auto &e: m_elements) e->Update();
+            //Captures this frame's input and updates every element with it
+            InputState input = InputState::Capture();
+            Update(input);
+        }
+
+        void Update(InputState &input){
+            /* Only the elements under the mouse or holding input, topmost first. Elements added later are drawn over
+             * earlier ones and see the input before them. Keys go to the focused element alone, after the mouse has
+             * had the chance to move the focus.*/
+            GuiElement *focused = focusManager.GetFocused();
+            if(focused && input.buttonPressed[MOUSE_LEFT_BUTTON] && !CheckCollisionPointRec(input.mouse, focused->GetScreenBounds())){
+                focused->Blur();
+            }
+            schedulerStats = {0, 0, 0};
+            m_scheduler.Dispatch(input);
+            m_schedulerStats = schedulerStats;
+            DispatchKeys(input);
+        }
+
+        void DispatchKeys(InputState &input){
+            if(input.IsKeyPressed(KEY_TAB)){
+                bool backwards = input.IsKeyDown(KEY_LEFT_SHIFT) || input.IsKeyDown(KEY_RIGHT_SHIFT);
+                if(MoveFocus(backwards ? -1 : 1)){
+                    input.ConsumeKeyboard();
+                    return;
+                }
+            }
+            GuiElement *focused = focusManager.GetFocused();
+            if(focused){
+                focused->KeyInput(input);
+                input.ConsumeKeyboard();
+            }
+        }
+
+        bool MoveFocus(int direction){
+            //Focuses the next (1) or previous (-1) focusable element in Tab order, wrapping around. False if there are none
+            std::vector<GuiElement*> elements;
+            for(auto &e: m_elements) e->CollectFocusable(elements);
+            if(elements.empty()) return false;
+            auto current = std::find(elements.begin(), elements.end(), focusManager.GetFocused());
+            size_t next;
+            if(current == elements.end()) next = direction > 0 ? 0 : elements.size() - 1;
+            else next = (current - elements.begin() + elements.size() + direction) % elements.size();
+            elements[next]->Focus();
+            return true;
+        }
+
+        [[nodiscard]] GuiElement *GetFocused() const {
+            return focusManager.GetFocused();
+        }
+
+        [[nodiscard]] bool HasPendingWork(){
+            //Whether the next frame would draw anything new: damage, an element that needs frames, or a PostWake
+            if(wakePosted || !damageTracker.Empty()) return true;
+            for(auto &e: m_elements){
+                if(e->HasPendingWork()) return true;
+            }
+            return false;
         }
 
         void Draw(){
-            for(auto &e: m_elements) e->Draw();
+            wakePosted = false;
+            if(m_batchDraws) drawList.Begin();
+            cullStats = {0, 0};
+            if(m_partialRedraw) DrawDamage();
+            else for(auto &e: m_elements) e->DrawClipped();
+            m_cullStats = cullStats;
+            damageTracker.Clear();
+            if(m_batchDraws) drawList.End();
+        }
+
+        void DrawDamage(){
+            /* The frame persists in m_canvas. Each merged damage region is cleared and only the elements touching it are
+             * redrawn, in order, under a scissor, then the canvas is drawn to the screen.*/
+            Rectangle screen = {0, 0, (float)Backend().GetScreenWidth(), (float)Backend().GetScreenHeight()};
+            if(m_canvas.id == 0 || m_canvas.texture.width != (int)screen.width || m_canvas.texture.height != (int)screen.height){
+                if(m_canvas.id != 0) Backend().UnloadRenderTarget(m_canvas);
+                m_canvas = Backend().LoadRenderTarget((int)screen.width, (int)screen.height);
+                InvalidateScreen();
+            }
+
+            m_lastDamage = damageTracker.Merge(screen, &m_damageStats);
+            if(!m_lastDamage.empty()){
+                BeginRenderTarget(m_canvas, {0, 0});
+                for(auto &region : m_lastDamage){
+                    BeginScissor(region);
+                    Backend().Clear(m_background);
+                    for(auto &e: m_elements) e->DrawClipped();
+                    EndScissor();
+                }
+                EndRenderTarget();
+            }
+            DrawTexturedRect(m_canvas.texture, {0, 0, screen.width, -screen.height}, screen, WHITE);
+
+            if(m_outlineDamage){
+                for(auto &region : m_lastDamage) DrawRectLines(region, 2, RED);
+            }
+        }
+
+        void EnablePartialRedraw(Color background){
+            //Only damaged regions are redrawn from now on. The caller no longer needs to clear the screen every frame
+            m_partialRedraw = true;
+            m_background = background;
+            InvalidateScreen();
+        }
+
+        void DisablePartialRedraw(){
+            m_partialRedraw = false;
+            if(m_canvas.id != 0) Backend().UnloadRenderTarget(m_canvas);
+            m_canvas = {0};
+        }
+
+        void EnableDrawBatching(){
+            m_batchDraws = true;
+        }
+
+        void DisableDrawBatching(){
+            //Every draw call goes to raylib as it is made
+            m_batchDraws = false;
+        }
+
+        void EnableDamageOutline(){
+            m_outlineDamage = true;
+        }
+
+        void DisableDamageOutline(){
+            m_outlineDamage = false;
         }
 
+        [[nodiscard]] const DamageStats &GetDamageStats() const {
+            //Damage of the last frame drawn with partial redraw
+            return m_damageStats;
+        }
+
+        [[nodiscard]] const SchedulerStats &GetSchedulerStats() const {
+            //Children visited, active and updated by the last Update, counted at every level of nesting
+            return m_schedulerStats;
+        }
+
+        [[nodiscard]] const CullStats &GetCullStats() const {
+            //Elements drawn and culled last frame, counted at every level of nesting
+            return m_cullStats;
+        }
+
+
+
+
+    };
+
+    bool CheckLayoutFontRelease(const char *fontPath = "times.ttf", int count = 100, FILE *stream = stdout){
+        /* Loads a layout of count buttons whose theme uses fontPath, destroys the runtime and checks the font registry is
+         * back where it started, so the fonts a layout loads are unloaded with it. fontPath must not be in use already.
+         * True if no font or font memory is left over */
+        json theme;
+        to_json(theme, LoadDefaultTheme());
+        theme = theme[0];
+        DefaultThemeId();
+        FontMemoryStats before = GetFontMemoryStats(); // With the default theme's font already loaded
+        theme["font"] = fontPath;
+        json elements = json::array();
+        for(int i = 0; i < count; i++){
+            json button;
+            button["rectangle"] = {10, 10 + i * 50, 100, 40};
+            button["text"] = "Button";
+            button["state"] = (int)Normal;
+            button["theme"] = theme;
+            button["textSettings"] = {{"horizontalAlign", 0}, {"verticalAlign", 1}, {"fontSize", 16}, {"fontMargin", {0.25, 0.25}}, {"spacing", 1}};
+            elements.push_back({{"ButtonPoll", button}});
+        }
+        json layout;
+        layout["RTKRuntime"]["elements"] = elements;
+
+        FontMemoryStats loaded;
+        {
+            RTKRuntime runtime(layout);
+            loaded = GetFontMemoryStats();
+        }
+        FontMemoryStats after = GetFontMemoryStats();
+        fprintf(stream,"Layout fonts: %zu fonts, %zu bytes loaded, %zu fonts, %zu bytes left after the runtime\n",
+                loaded.fonts - before.fonts,loaded.textureBytes + loaded.cpuBytes - before.textureBytes - before.cpuBytes,
+                after.fonts - before.fonts,after.textureBytes + after.cpuBytes - before.textureBytes - before.cpuBytes);
+        return after.fonts == before.fonts && after.references == before.references &&
+               after.textureBytes == before.textureBytes && after.cpuBytes == before.cpuBytes;
+    }
+
+#define INPUT_RECORDING_MAGIC 0x494B5452u // "RTKI" read as little endian
+#define INPUT_RECORDING_VERSION 2
+
+    class InputRecorder{
+        /* Writes the InputState of every frame to a binary file for InputPlayer. After a header of magic and version,
+         * each frame is its frame time, mouse position, delta and wheel as floats, a 16 bit mask of button down, pressed and
+         * released bits, then three lists of 16 bit key codes, each preceded by its length: keys that went down or up
+         * since the previous frame, keys pressed this frame, and the key queue. Values are written in the machine's
+         * byte order, recordings are meant to be replayed on the machine type they were made on.*/
+        FILE *m_file = nullptr;
+        std::array<bool,INPUT_KEY_COUNT> m_keyDown{};
+        size_t m_frames = 0;
+        std::vector<uint16_t> m_list;
+
+        void WriteList(){
+            uint16_t count = (uint16_t)m_list.size();
+            fwrite(&count, sizeof(count), 1, m_file);
+            fwrite(m_list.data(), sizeof(uint16_t), m_list.size(), m_file);
+        }
+
+    public:
+        InputRecorder() = default;
+        InputRecorder(const InputRecorder&) = delete;
+
+        ~InputRecorder(){
+            Close();
+        }
+
+        bool Open(const char *path){
+            Close();
+            m_file = fopen(path, "wb");
+            if(!m_file) return false;
+            uint32_t header[2] = {INPUT_RECORDING_MAGIC, INPUT_RECORDING_VERSION};
+            fwrite(header, sizeof(header), 1, m_file);
+            m_keyDown.fill(false);
+            m_frames = 0;
+            return true;
+        }
+
+        void Close(){
+            if(m_file) fclose(m_file);
+            m_file = nullptr;
+        }
+
+        [[nodiscard]] bool IsOpen() const {
+            return m_file != nullptr;
+        }
+
+        [[nodiscard]] size_t GetFrameCount() const {
+            return m_frames;
+        }
+
+        void Record(const InputState &input){
+            //Call once per frame with the snapshot as captured, before anything consumes it
+            if(!m_file) return;
+            float values[6] = {input.frameTime, input.mouse.x, input.mouse.y, input.mouseDelta.x, input.mouseDelta.y, input.mouseWheel};
+            fwrite(values, sizeof(values), 1, m_file);
+            uint16_t buttons = 0;
+            for(int button = 0; button < 3; button++){
+                buttons |= (uint16_t)(input.buttonDown[button] << button);
+                buttons |= (uint16_t)(input.buttonPressed[button] << (button + 3));
+                buttons |= (uint16_t)(input.buttonReleased[button] << (button + 6));
+            }
+            fwrite(&buttons, sizeof(buttons), 1, m_file);
+
+            m_list.clear();
+            for(int key = 1; key < INPUT_KEY_COUNT; key++){
+                if(input.keyDown[key] != m_keyDown[key]) m_list.push_back((uint16_t)key);
+            }
+            m_keyDown = input.keyDown;
+            WriteList();
+            m_list.clear();
+            for(int key = 1; key < INPUT_KEY_COUNT; key++){
+                if(input.keyPressed[key]) m_list.push_back((uint16_t)key);
+            }
+            WriteList();
+            m_list.assign(input.keys.begin(), input.keys.end());
+            WriteList();
+            m_frames++;
+        }
+    };
+
+    class InputPlayer{
+        //Reads back what InputRecorder wrote, one InputState per frame
+        FILE *m_file = nullptr;
+        std::array<bool,INPUT_KEY_COUNT> m_keyDown{};
+        std::vector<uint16_t> m_list;
+
+        bool ReadList(){
+            uint16_t count;
+            if(fread(&count, sizeof(count), 1, m_file) != 1) return false;
+            m_list.resize(count);
+            return fread(m_list.data(), sizeof(uint16_t), count, m_file) == count;
+        }
+
+    public:
+        InputPlayer() = default;
+        InputPlayer(const InputPlayer&) = delete;
+
+        ~InputPlayer(){
+            Close();
+        }
+
+        bool Open(const char *path){
+            //False if the file is missing or is not a recording of this version
+            Close();
+            m_file = fopen(path, "rb");
+            if(!m_file) return false;
+            uint32_t header[2];
+            if(fread(header, sizeof(header), 1, m_file) != 1 || header[0] != INPUT_RECORDING_MAGIC || header[1] != INPUT_RECORDING_VERSION){
+                Close();
+                return false;
+            }
+            m_keyDown.fill(false);
+            return true;
+        }
+
+        void Close(){
+            if(m_file) fclose(m_file);
+            m_file = nullptr;
+        }
+
+        bool Next(InputState &input){
+            //The next frame's input, false at the end of the recording
+            if(!m_file) return false;
+            input = InputState();
+            float values[6];
+            uint16_t buttons;
+            if(fread(values, sizeof(values), 1, m_file) != 1 || fread(&buttons, sizeof(buttons), 1, m_file) != 1) return false;
+            input.frameTime = values[0];
+            input.mouse = {values[1], values[2]};
+            input.mouseDelta = {values[3], values[4]};
+            input.mouseWheel = values[5];
+            for(int button = 0; button < 3; button++){
+                input.buttonDown[button] = buttons >> button & 1;
+                input.buttonPressed[button] = buttons >> (button + 3) & 1;
+                input.buttonReleased[button] = buttons >> (button + 6) & 1;
+            }
+
+            if(!ReadList()) return false;
+            for(auto key : m_list){
+                if(key < INPUT_KEY_COUNT) m_keyDown[key] = !m_keyDown[key];
+            }
+            input.keyDown = m_keyDown;
+            if(!ReadList()) return false;
+            for(auto key : m_list){
+                if(key < INPUT_KEY_COUNT) input.keyPressed[key] = true;
+            }
+            if(!ReadList()) return false;
+            input.keys.assign(m_list.begin(), m_list.end());
+            return true;
+        }
+    };
 
+    struct FrameTiming{
+        double update; // Microseconds
+        double draw;
+    };
+
+    struct ReplayReport{
+        std::vector<FrameTiming> frames;
 
+        void Print(FILE *stream = stdout) const {
+            //Totals, means, medians and worst frames of Update and Draw
+            if(frames.empty()){
+                fprintf(stream,"Replay: no frames\n");
+                return;
+            }
+            std::vector<double> update, draw;
+            for(auto &frame : frames){
+                update.push_back(frame.update);
+                draw.push_back(frame.draw);
+            }
+            fprintf(stream,"Replay: %zu frames\n",frames.size());
+            for(auto pass : {std::make_pair("Update", &update), std::make_pair("Draw", &draw)}){
+                std::vector<double> &times = *pass.second;
+                double total = 0;
+                for(auto t : times) total += t;
+                std::sort(times.begin(), times.end());
+                fprintf(stream,"%s: total %f ms, mean %f us, median %f us, p99 %f us, worst %f us\n",pass.first,total / 1000,
+                        total / times.size(),times[times.size() / 2],times[std::min(times.size() - 1, times.size() * 99 / 100)],times.back());
+            }
+        }
 
+        bool WriteCsv(const char *path) const {
+            //One line per frame: frame, update, draw, in microseconds
+            FILE *file = fopen(path, "w");
+            if(!file) return false;
+            fprintf(file,"frame,update_us,draw_us\n");
+            for(size_t i = 0; i < frames.size(); i++) fprintf(file,"%zu,%f,%f\n",i,frames[i].update,frames[i].draw);
+            fclose(file);
+            return true;
+        }
     };
 
+    ReplayReport ReplayInput(RTKRuntime &runtime, const char *path, bool draw = true){
+        /* Runs a recording through runtime one frame at a time, timing each Update and Draw. Without a window, set a
+         * NullBackend or SoftwareBackend before creating the runtime's elements. A headless backend also reports the
+         * recorded frame time. The report is empty if the recording can't be read.*/
+        ReplayReport report;
+        InputPlayer player;
+        if(!player.Open(path)) return report;
+        auto *headless = dynamic_cast<HeadlessBackend*>(&Backend());
+        InputState input;
+        while(player.Next(input)){
+            if(headless) headless->SetFrameTime(input.frameTime);
+            FrameTiming timing = {0, 0};
+            auto start = std::chrono::steady_clock::now();
+            runtime.Update(input);
+            timing.update = std::chrono::duration<double,std::micro>(std::chrono::steady_clock::now() - start).count();
+            if(draw){
+                start = std::chrono::steady_clock::now();
+                runtime.Draw();
+                timing.draw = std::chrono::duration<double,std::micro>(std::chrono::steady_clock::now() - start).count();
+            }
+            report.frames.push_back(timing);
+        }
+        return report;
+    }
+
 // TODO: Implement the following elements:
 // Separate classes into different files, ideally header and implementation files.
 /*